@@ -0,0 +1,111 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : capture.c
+//
+// Binary traffic capture: a small header, then one record per datagram
+// with its time, direction, peer address and raw bytes.
+//---------------------------------------------------------------------
+
+#include <time.h>
+
+#include "wrappers.h"
+#include "capture.h"
+
+long long capNowUs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 ;
+}
+
+/*--------------------------------------------------------------------
+   Start a new capture file
+----------------------------------------------------------------------*/
+capture_t *capCreate( const char *path )
+{
+    capture_t  *c = calloc( 1 , sizeof( capture_t ) ) ;
+    capHeader   hdr ;
+    struct timeval tv ;
+
+    if ( c == NULL )
+        err_quit( "capture: out of memory\n" ) ;
+    if ( ( c->fp = fopen( path , "wb" ) ) == NULL )
+        err_sys( "capture: cannot create capture file" ) ;
+
+    gettimeofday( &tv , NULL ) ;
+    c->startUs   = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec ;
+    c->startMono = capNowUs() ;
+
+    memset( &hdr , 0 , sizeof( hdr ) ) ;
+    hdr.magic   = CAP_MAGIC ;
+    hdr.version = CAP_VERSION ;
+    hdr.startUs = c->startUs ;
+    if ( fwrite( &hdr , sizeof( hdr ) , 1 , c->fp ) != 1 )
+        err_sys( "capture: write failed" ) ;
+    return c ;
+}
+
+//------------------
+// Record one datagram. A NULL capture records nothing.
+
+void capRecord( capture_t *c , capDir_t dir , const struct sockaddr_in *peer ,
+                const void *data , size_t len )
+{
+    capRecHdr  h ;
+
+    if ( c == NULL )
+        return ;
+
+    memset( &h , 0 , sizeof( h ) ) ;
+    h.tUs      = capNowUs() - c->startMono ;
+    h.peerIP   = peer->sin_addr.s_addr ;
+    h.peerPort = peer->sin_port ;
+    h.dir      = dir ;
+    h.len      = len ;
+    if ( fwrite( &h , sizeof( h ) , 1 , c->fp ) != 1
+         || fwrite( data , 1 , len , c->fp ) != len )
+        err_sys( "capture: write failed" ) ;
+}
+
+//------------------
+
+void capClose( capture_t *c )
+{
+    if ( c == NULL )
+        return ;
+    fclose( c->fp ) ;
+    free( c ) ;
+}
+
+/*--------------------------------------------------------------------
+   Open an existing capture for reading
+----------------------------------------------------------------------*/
+capture_t *capOpenRead( const char *path )
+{
+    capture_t  *c = calloc( 1 , sizeof( capture_t ) ) ;
+    capHeader   hdr ;
+
+    if ( c == NULL )
+        err_quit( "capture: out of memory\n" ) ;
+    if ( ( c->fp = fopen( path , "rb" ) ) == NULL )
+        err_sys( "capture: cannot open capture file" ) ;
+    if ( fread( &hdr , sizeof( hdr ) , 1 , c->fp ) != 1
+         || hdr.magic != CAP_MAGIC || hdr.version != CAP_VERSION )
+        err_quit( "capture: not a capture file\n" ) ;
+
+    c->startUs = hdr.startUs ;
+    return c ;
+}
+
+//------------------
+// Read the next record into 'h' and 'data' ( CAP_MAXDATA bytes ).
+// Returns 0 at the end of the file or at a truncated record.
+
+int capNext( capture_t *c , capRecHdr *h , void *data )
+{
+    if ( fread( h , sizeof( *h ) , 1 , c->fp ) != 1 || h->len > CAP_MAXDATA )
+        return 0 ;
+    return fread( data , 1 , h->len , c->fp ) == h->len ;
+}
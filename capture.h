@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : capture.h
+//---------------------------------------------------------------------
+
+#ifndef  CAPTURE_H
+#define  CAPTURE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#define CAP_MAGIC     0x46434150       /* "FCAP" */
+#define CAP_VERSION   1
+#define CAP_MAXDATA   65536            /* largest datagram we will record */
+
+typedef enum { CAP_SENT = 0 , CAP_RCVD = 1 } capDir_t ;
+
+typedef struct {
+
+    uint32_t    magic ;
+    uint16_t    version ,
+                pad ;
+    uint64_t    startUs ;       /* wall-clock time of the first record, uSec since the epoch */
+
+} capHeader ;
+
+typedef struct {
+
+    uint64_t    tUs ;           /* uSec since the capture started */
+    uint32_t    peerIP ;        /* the other side, network byte order */
+    uint16_t    peerPort ;      /* network byte order */
+    uint8_t     dir ;           /* capDir_t */
+    uint8_t     pad ;
+    uint32_t    len ;           /* bytes of datagram that follow */
+
+} capRecHdr ;
+
+typedef struct {
+
+    FILE       *fp ;
+    long long   startMono ;     /* monotonic uSec matching record time 0 */
+    uint64_t    startUs ;
+
+} capture_t ;
+
+long long   capNowUs   ( void ) ;
+capture_t  *capCreate  ( const char *path ) ;
+void        capRecord  ( capture_t *c , capDir_t dir , const struct sockaddr_in *peer ,
+                         const void *data , size_t len ) ;
+void        capClose   ( capture_t *c ) ;
+
+capture_t  *capOpenRead( const char *path ) ;
+int         capNext    ( capture_t *c , capRecHdr *h , void *data ) ;
+
+#endif
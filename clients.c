@@ -0,0 +1,277 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : clients.c
+//
+// Per-client fair share of the factory lines. Every client IP has its
+// own run queue, a weight, and token buckets for parts and production
+// reports per second. Lines serve the eligible client with the lowest
+// weighted pass ( stride scheduling ), so one heavy client cannot
+// starve the others, and a client out of tokens simply waits.
+// Listed clients come from a rates file; others get the defaults on
+// first contact. All entries are allocated at startup.
+// The caller provides the locking.
+//---------------------------------------------------------------------
+
+#include <arpa/inet.h>
+#include <time.h>
+
+#include "wrappers.h"
+#include "clients.h"
+
+#define HASHSIZE    ( 2 * MAXCLIENTS )      /* load factor <= 1/2 */
+#define LINELEN     200
+
+static long long nowUs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 ;
+}
+
+static uint32_t hashIP( uint32_t ip )
+{
+    return ( ip * 0x9E3779B1u ) >> 19 ;     // top 13 bits, HASHSIZE buckets
+}
+
+//------------------
+// Put a client in the table, or find it there. Returns CLIENT_NIL when full.
+
+static uint32_t addClient( clientTable_t *ct , uint32_t ip )
+{
+    uint32_t b = hashIP( ip ) ;
+
+    for ( ; ct->hash[ b ] != CLIENT_NIL ; b = ( b + 1 ) % HASHSIZE )
+        if ( ct->tab[ ct->hash[ b ] ].ip == ip )
+            return ct->hash[ b ] ;
+
+    if ( ct->used == MAXCLIENTS )
+        return CLIENT_NIL ;
+
+    uint32_t  c = ct->used++ ;
+    client_t *e = &ct->tab[ c ] ;
+    *e = ct->tab[ 0 ] ;                     // start from the defaults
+    e->ip           = ip ;
+    e->partTokens   = e->partRate ;
+    e->reportTokens = e->reportRate ;
+    e->refillUs     = nowUs() ;
+    e->pass         = ct->vtime ;
+    e->activeSlot   = CLIENT_NIL ;
+    sessQueueInit( &e->queue ) ;
+    ct->hash[ b ] = c ;
+    return c ;
+}
+
+/*--------------------------------------------------------------------
+   Allocate the table. Until a rates file says otherwise, every
+   client has weight 1 and no limits.
+----------------------------------------------------------------------*/
+void clientsInit( clientTable_t *ct )
+{
+    memset( ct , 0 , sizeof( *ct ) ) ;
+    ct->tab    = calloc( MAXCLIENTS , sizeof( client_t ) ) ;
+    ct->hash   = malloc( HASHSIZE * sizeof( uint32_t ) ) ;
+    ct->active = malloc( MAXCLIENTS * sizeof( uint32_t ) ) ;
+    if ( ct->tab == NULL || ct->hash == NULL || ct->active == NULL )
+        err_quit( "client table: out of memory\n" ) ;
+    memset( ct->hash , 0xFF , HASHSIZE * sizeof( uint32_t ) ) ;
+
+    client_t *d = &ct->tab[ 0 ] ;           // the defaults, also the overflow entry
+    d->weight     = 1 ;
+    d->refillUs   = nowUs() ;
+    d->activeSlot = CLIENT_NIL ;
+    sessQueueInit( &d->queue ) ;
+    ct->used = 1 ;
+}
+
+/*--------------------------------------------------------------------
+   Read per-client limits, one client per line:
+       <IP | default>  <weight>  <partsPerSec>  <reportsPerSec>
+   A rate of 0 means unlimited. '#' starts a comment.
+   Returns the number of entries read.
+----------------------------------------------------------------------*/
+int clientsLoad( clientTable_t *ct , const char *path )
+{
+    char   line[ LINELEN ] , who[ 64 ] , msg[ LINELEN ] ;
+    int    lineNo = 0 , loaded = 0 ;
+    FILE  *f = fopen( path , "r" ) ;
+
+    if ( f == NULL )
+        err_sys( "client table: cannot open the rates file" ) ;
+
+    while ( fgets( line , LINELEN , f ) != NULL )
+    {
+        unsigned  weight ;
+        double    partRate , reportRate ;
+        uint32_t  ip = 0 , c ;
+
+        lineNo++ ;
+        line[ strcspn( line , "#\n" ) ] = '\0' ;
+        if ( sscanf( line , "%63s" , who ) != 1 )
+            continue ;          // blank or comment
+
+        if ( sscanf( line , "%*s %u %lf %lf" , &weight , &partRate , &reportRate ) != 3
+             || weight == 0 || partRate < 0 || reportRate < 0
+             || ( strcmp( who , "default" ) != 0 && inet_pton( AF_INET , who , &ip ) != 1 ) )
+        {
+            snprintf( msg , LINELEN , "client table: bad entry on line %d of '%s'\n" , lineNo , path ) ;
+            err_quit( msg ) ;
+        }
+
+        if ( ip == 0 )
+            c = 0 ;
+        else if ( ( c = addClient( ct , ip ) ) == CLIENT_NIL )
+            err_quit( "client table: too many clients in the rates file\n" ) ;
+
+        client_t *e = &ct->tab[ c ] ;
+        e->weight       = weight ;
+        e->partRate     = e->partTokens   = partRate ;
+        e->reportRate   = e->reportTokens = reportRate ;
+        loaded++ ;
+    }
+    fclose( f ) ;
+    return loaded ;
+}
+
+//------------------
+// The entry for a client; unlisted clients share entry 0 once the table is full
+
+uint32_t clientFor( clientTable_t *ct , uint32_t ip )
+{
+    uint32_t c = addClient( ct , ip ) ;
+    return c == CLIENT_NIL ? 0 : c ;
+}
+
+//------------------
+// Queue an order behind the client's other orders
+
+void clientEnqueue( clientTable_t *ct , sessStore_t *st , sessHandle_t h )
+{
+    session_t *s = sessGet( st , h ) ;
+    if ( s == NULL )
+        return ;
+
+    client_t *e = &ct->tab[ s->client ] ;
+    sessEnqueue( st , &e->queue , h ) ;
+    if ( e->activeSlot == CLIENT_NIL )
+    {
+        // Coming back from idle: no credit for the time spent away
+        if ( e->pass < ct->vtime )
+            e->pass = ct->vtime ;
+        e->activeSlot = ct->numActive ;
+        ct->active[ ct->numActive++ ] = s->client ;
+    }
+}
+
+//------------------
+// Top up both buckets for the time elapsed, capped at one second's worth
+// ( but never below one token, or a slow bucket could not be used at all )
+
+static double topUp( double tokens , double secs , double rate )
+{
+    double cap = rate < 1 ? 1 : rate ;
+    tokens += secs * rate ;
+    return tokens > cap ? cap : tokens ;
+}
+
+static void refill( client_t *e , long long now )
+{
+    double secs = ( now - e->refillUs ) / 1e6 ;
+
+    e->refillUs = now ;
+    if ( e->partRate > 0 )
+        e->partTokens = topUp( e->partTokens , secs , e->partRate ) ;
+    if ( e->reportRate > 0 )
+        e->reportTokens = topUp( e->reportTokens , secs , e->reportRate ) ;
+}
+
+//------------------
+// uSec until a bucket holds 'need' tokens
+
+static long long untilTokens( double tokens , double need , double rate )
+{
+    return rate > 0 && tokens < need ? (long long) ( ( need - tokens ) / rate * 1e6 ) + 1 : 0 ;
+}
+
+/*--------------------------------------------------------------------
+   Take the next order to claim from: the head of the queue of the
+   eligible client with the lowest pass. A client is eligible when it
+   has a report token and enough part tokens for a full batch of
+   'want' parts ( or of what its next order still needs, or of what
+   its bucket can hold ), so that throttled clients are not served
+   in dribbles that waste a report each. *maxParts is how many parts
+   its tokens allow ( INT_MAX when unlimited ).
+   Returns SESS_NIL when nothing can be claimed now; *waitUs is then
+   how long until a throttled client can go again, or -1 when every
+   queue is empty.
+   Cancelled orders are handed out regardless of tokens so they can
+   be dropped.
+----------------------------------------------------------------------*/
+sessHandle_t clientPick( clientTable_t *ct , sessStore_t *st , int want , int *maxParts , long long *waitUs )
+{
+    long long  now  = nowUs() ;
+    uint32_t   best = CLIENT_NIL ;
+
+    *waitUs = -1 ;
+    for ( uint32_t i = 0 ; i < ct->numActive ; i++ )
+    {
+        client_t *e = &ct->tab[ ct->active[ i ] ] ;
+
+        session_t *head = &st->slots[ e->queue.head ] ;
+        if ( head->flags & SESS_CANCELLED ) {
+            best = ct->active[ i ] ;
+            break ;
+        }
+
+        double need = want < head->remains ? want : head->remains ;
+        if ( need > e->partRate && e->partRate > 0 )
+            need = e->partRate < 1 ? 1 : e->partRate ;
+
+        refill( e , now ) ;
+        long long wait = untilTokens( e->partTokens , need , e->partRate ) ;
+        long long w2   = untilTokens( e->reportTokens , 1 , e->reportRate ) ;
+        if ( w2 > wait )
+            wait = w2 ;
+
+        if ( wait > 0 ) {
+            if ( *waitUs < 0 || wait < *waitUs )
+                *waitUs = wait ;
+        }
+        else if ( best == CLIENT_NIL || e->pass < ct->tab[ best ].pass )
+            best = ct->active[ i ] ;
+    }
+    if ( best == CLIENT_NIL )
+        return SESS_NIL ;
+
+    client_t     *e = &ct->tab[ best ] ;
+    sessHandle_t  h = sessDequeue( st , &e->queue ) ;
+
+    if ( e->queue.head == SESS_NIL )
+    {
+        // Idle now: swap the last active client into this one's slot
+        uint32_t last = ct->active[ --ct->numActive ] ;
+        ct->active[ e->activeSlot ] = last ;
+        ct->tab[ last ].activeSlot = e->activeSlot ;
+        e->activeSlot = CLIENT_NIL ;
+    }
+
+    *maxParts = e->partRate > 0 ? (int) e->partTokens : 0x7FFFFFFF ;
+    return h ;
+}
+
+//------------------
+// A line claimed 'parts' for client 'c': spend its tokens and advance its pass
+
+void clientCharge( clientTable_t *ct , uint32_t c , int parts )
+{
+    client_t *e = &ct->tab[ c ] ;
+
+    if ( e->partRate > 0 )
+        e->partTokens -= parts ;
+    if ( e->reportRate > 0 )
+        e->reportTokens -= 1 ;      // every claim ends in one production report
+
+    ct->vtime = e->pass ;
+    e->pass  += (uint64_t) parts * CLIENT_STRIDE / e->weight ;
+}
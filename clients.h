@@ -0,0 +1,51 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : clients.h
+//---------------------------------------------------------------------
+
+#ifndef  CLIENTS_H
+#define  CLIENTS_H
+#include <sys/types.h>
+#include <stdint.h>
+#include "session.h"
+
+#define MAXCLIENTS      4096        /* distinct client IPs with their own share */
+#define CLIENT_STRIDE   ( 1u << 16 ) /* pass advance for one part at weight 1 */
+#define CLIENT_NIL      0xFFFFFFFFu
+
+typedef struct {
+
+    uint32_t    ip ;            /* network byte order, 0 for the default entry */
+    unsigned    weight ;        /* share of the lines relative to other clients */
+    double      partRate ,      /* token refill per second, 0 = unlimited */
+                reportRate ,
+                partTokens ,    /* tokens available now, at most one second's worth */
+                reportTokens ;
+    long long   refillUs ;      /* when the buckets were last topped up */
+    uint64_t    pass ;          /* stride scheduling: weighted parts claimed so far */
+    uint32_t    activeSlot ;    /* index in the active list, CLIENT_NIL when idle */
+    sessQueue_t queue ;         /* this client's orders with parts left to claim */
+
+} client_t ;
+
+typedef struct {
+
+    client_t   *tab ;           /* entry 0 holds the defaults for unlisted clients */
+    uint32_t   *hash ;          /* open-addressed IP -> entry */
+    uint32_t   *active ;        /* entries with a non-empty queue */
+    uint32_t    used ,
+                numActive ;
+    uint64_t    vtime ;         /* pass of the last client served */
+
+} clientTable_t ;
+
+void          clientsInit   ( clientTable_t *ct ) ;
+int           clientsLoad   ( clientTable_t *ct , const char *path ) ;
+uint32_t      clientFor     ( clientTable_t *ct , uint32_t ip ) ;
+void          clientEnqueue ( clientTable_t *ct , sessStore_t *st , sessHandle_t h ) ;
+sessHandle_t  clientPick    ( clientTable_t *ct , sessStore_t *st , int want , int *maxParts , long long *waitUs ) ;
+void          clientCharge  ( clientTable_t *ct , uint32_t c , int parts ) ;
+
+#endif
@@ -0,0 +1,634 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : coordinator.c
+//
+// Speaks the factory protocol to procurement, but makes the parts on
+// several factory servers. Each order is split across the back-ends in
+// proportion to the parts per second they advertise, and their reports
+// are relayed back with the lines renumbered 1..numFac over all of them.
+//
+//   procurement  --->  coordinator <listenPort>  --->  factory <ip:port>
+//                                                 --->  factory <ip:port> ...
+//
+// The client sees one ORDR_CONFIRM for the total number of lines, then
+// the usual PRODUCTION and COMPLETION messages. One socket per back-end
+// keeps their replies apart.
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <stdint.h>
+
+#include "wrappers.h"
+#include "message.h"
+
+#define MAXBACKENDS     16          /* factory servers behind one coordinator */
+#define MAXFANOUT       256         /* client orders in flight at once */
+#define MAXHELD         64          /* reports that beat the last confirmation */
+#define MAXDGRAM        sizeof( bulkMsgBuf )
+#define PROBE_TRIES     3
+#define IPSTRLEN        50
+
+typedef struct sockaddr SA ;
+
+typedef struct {
+    char                name[ IPSTRLEN ] ;  /* "ip:port" as given */
+    struct sockaddr_in  addr ;
+    int                 sd ;                /* connected to this back-end only */
+    unsigned            numFac , capacity , duration ;
+    double              rate ;              /* advertised parts per second , 0 = not serving */
+} backend_t ;
+
+enum { FO_FREE = 0 , FO_CONFIRMING , FO_RUNNING , FO_CANCELLING } ;
+
+typedef struct {
+    int                 state ;
+    unsigned            id ;                /* our order ID at the back-ends */
+    struct sockaddr_in  client ;
+    unsigned            clientOrder , orderSize ;
+    unsigned            share[ MAXBACKENDS ] ,      /* parts given to each back-end */
+                        numFac[ MAXBACKENDS ] ,     /* lines each back-end confirmed */
+                        offset[ MAXBACKENDS ] ,     /* added to its facIDs */
+                        linesLeft[ MAXBACKENDS ] ,  /* completions still due from it */
+                        made[ MAXBACKENDS ] ;       /* parts it reported */
+    uint32_t            involved ,          /* back-ends with a share , one bit each */
+                        replied ;           /* ... that confirmed ( or confirmed the cancel ) */
+    int                 confirmed ;         /* the client has its ORDR_CONFIRM */
+    unsigned            cnclMade ;          /* parts made , summed over the cancel confirmations */
+    long long           deadlineUs ;        /* for the back-ends' replies , or their next report */
+    int                 numHeld ;
+    struct {
+        int             b ;
+        msgBuf          m ;
+    }                   held[ MAXHELD ] ;
+} fanout_t ;
+
+backend_t   backends[ MAXBACKENDS ] ;
+int         numBackends = 0 ;
+double      totalRate = 0 ;
+
+fanout_t    fanouts[ MAXFANOUT ] ;
+unsigned    lastID = 0 ;
+int         replyMs = 2000 ;        // how long a back-end may take to answer
+int         idleMs  = 30000 ;       // how long a running order may go without a report
+
+int         cliSd ;                 // clients send to this socket
+unsigned long ordersIn = 0 , ordersDone = 0 , ordersCancelled = 0 , ordersFailed = 0 ;
+volatile sig_atomic_t  done = 0 ;
+
+long long nowUs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 ;
+}
+
+void stopCoordinator( int sig )
+{
+    done = 1 ;
+}
+
+//------------------------------------------------------------
+//  Send one message to a client or to a back-end
+//------------------------------------------------------------
+void toClient( fanout_t *fo , msgBuf *m )
+{
+    if ( sendto( cliSd , (void *) m , sizeof( *m ) , 0 , (SA *) &fo->client , sizeof( fo->client ) ) < 0 )
+        err_sys( "Error sending to the client" ) ;
+}
+
+void toBackend( int b , msgPurpose_t purpose , unsigned orderID , unsigned orderSize )
+{
+    msgBuf m ;
+    memset( (void *) &m , 0 , sizeof( m ) ) ;
+    m.purpose   = htonl( purpose ) ;
+    m.orderID   = htonl( orderID ) ;
+    m.orderSize = htonl( orderSize ) ;
+
+    // A back-end that went away shows up as ECONNREFUSED; its orders time out
+    if ( send( backends[ b ].sd , (void *) &m , sizeof( m ) , 0 ) < 0 && errno != ECONNREFUSED )
+        err_sys( "Error sending to a back-end" ) ;
+}
+
+void replyProtocolErr( struct sockaddr_in *to , unsigned clientOrder )
+{
+    msgBuf errMsg ;
+    memset( (void *) &errMsg , 0 , sizeof( errMsg ) ) ;
+    errMsg.purpose = htonl( PROTOCOL_ERR ) ;
+    errMsg.orderID = htonl( clientOrder ) ;     // 0 when it is not about an order
+    if ( sendto( cliSd , (void *) &errMsg , sizeof( errMsg ) , 0 , (SA *) to , sizeof( *to ) ) < 0 )
+        err_sys( "Error sending the protocol error message" ) ;
+}
+
+//------------------------------------------------------------
+//  Ask every back-end for its lines and their pace. Those that
+//  do not answer get no share of the orders.
+//------------------------------------------------------------
+void probeBackends( void )
+{
+    for ( int b = 0 ; b < numBackends ; b++ )
+    {
+        backend_t *be = &backends[ b ] ;
+
+        for ( int t = 0 ; t < PROBE_TRIES && be->rate == 0 ; t++ )
+        {
+            toBackend( b , CAPACITY_QUERY , 0 , 0 ) ;
+
+            struct pollfd pfd = { be->sd , POLLIN , 0 } ;
+            msgBuf  info ;
+            if ( poll( &pfd , 1 , replyMs / PROBE_TRIES ) <= 0
+                 || recv( be->sd , (void *) &info , sizeof( info ) , 0 ) < (ssize_t) sizeof( info )
+                 || ntohl( info.purpose ) != CAPACITY_INFO )
+                continue ;
+
+            be->numFac   = ntohl( info.numFac ) ;
+            be->capacity = ntohl( info.capacity ) ;
+            be->duration = ntohl( info.duration ) ;
+            if ( be->numFac > 0 && be->capacity > 0 && be->duration > 0 )
+                be->rate = be->numFac * be->capacity * 1000.0 / be->duration ;
+        }
+
+        if ( be->rate > 0 )
+            printf( "COORDINATOR: back-end %-21s %3u lines x %4u parts / %5u mSec = %8.1f parts/sec\n"
+                  , be->name , be->numFac , be->capacity , be->duration , be->rate ) ;
+        else
+            printf( "COORDINATOR: back-end %-21s did not answer, it gets no orders\n" , be->name ) ;
+        totalRate += be->rate ;
+    }
+    fflush( stdout ) ;
+}
+
+//------------------------------------------------------------
+//  Split an order in proportion to the back-ends' rates,
+//  handing out the rounding leftovers by largest remainder
+//------------------------------------------------------------
+void splitOrder( fanout_t *fo )
+{
+    double    frac[ MAXBACKENDS ] ;
+    unsigned  given = 0 ;
+
+    for ( int b = 0 ; b < numBackends ; b++ ) {
+        double exact  = fo->orderSize * backends[ b ].rate / totalRate ;
+        fo->share[ b ] = (unsigned) exact ;
+        frac[ b ]      = exact - fo->share[ b ] ;
+        given         += fo->share[ b ] ;
+    }
+
+    for ( ; given < fo->orderSize ; given++ ) {
+        int best = -1 ;
+        for ( int b = 0 ; b < numBackends ; b++ )
+            if ( backends[ b ].rate > 0 && ( best < 0 || frac[ b ] > frac[ best ] ) )
+                best = b ;
+        fo->share[ best ]++ ;
+        frac[ best ] = -1 ;
+    }
+
+    // An empty order still needs one back-end to confirm and complete it
+    fo->involved = 0 ;
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->share[ b ] > 0 )
+            fo->involved |= 1u << b ;
+    for ( int b = 0 ; fo->involved == 0 ; b++ )
+        if ( backends[ b ].rate > 0 )
+            fo->involved = 1u << b ;
+}
+
+//------------------------------------------------------------
+//  Look up an order in flight
+//------------------------------------------------------------
+fanout_t *findByID( unsigned id )
+{
+    for ( int i = 0 ; i < MAXFANOUT ; i++ )
+        if ( fanouts[ i ].state != FO_FREE && fanouts[ i ].id == id )
+            return &fanouts[ i ] ;
+    return NULL ;
+}
+
+fanout_t *findByClient( struct sockaddr_in *from , unsigned clientOrder )
+{
+    for ( int i = 0 ; i < MAXFANOUT ; i++ )
+        if ( fanouts[ i ].state != FO_FREE && fanouts[ i ].clientOrder == clientOrder
+             && fanouts[ i ].client.sin_addr.s_addr == from->sin_addr.s_addr
+             && fanouts[ i ].client.sin_port == from->sin_port )
+            return &fanouts[ i ] ;
+    return NULL ;
+}
+
+//------------------------------------------------------------
+//  Give up on an order: the client gets a Protocol Error and
+//  the back-ends are told to drop their shares
+//------------------------------------------------------------
+void failOrder( fanout_t *fo , const char *why )
+{
+    printf( "COORDINATOR: order #%u ( client order %u ) failed: %s\n" , fo->id , fo->clientOrder , why ) ;
+    replyProtocolErr( &fo->client , fo->clientOrder ) ;
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->involved & ( 1u << b ) )
+            toBackend( b , CANCEL_MSG , fo->id , 0 ) ;
+    fo->state = FO_FREE ;
+    ordersFailed++ ;
+}
+
+//------------------------------------------------------------
+//  Relay one back-end report with its line renumbered
+//------------------------------------------------------------
+void relayReport( fanout_t *fo , int b , msgBuf *m )
+{
+    unsigned facID = ntohl( m->facID ) ;
+
+    if ( facID < 1 || facID > fo->numFac[ b ] )
+        return ;            // not a line this back-end confirmed
+    m->facID   = htonl( fo->offset[ b ] + facID ) ;
+    m->orderID = htonl( fo->clientOrder ) ;
+    toClient( fo , m ) ;
+    fo->deadlineUs = nowUs() + idleMs * 1000LL ;    // the back-ends are still at it
+
+    if ( ntohl( m->purpose ) == PRODUCTION_MSG )
+        fo->made[ b ] += ntohl( m->partsMade ) ;
+    else if ( fo->linesLeft[ b ] > 0 )
+        fo->linesLeft[ b ]-- ;
+}
+
+//------------------------------------------------------------
+//  Send the client its aggregate Order Confirmation: every
+//  line of every back-end that took a share
+//------------------------------------------------------------
+void sendConfirm( fanout_t *fo )
+{
+    unsigned total = 0 ;
+
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->involved & ( 1u << b ) )
+            total += fo->numFac[ b ] ;
+
+    msgBuf cnfMsg ;
+    memset( (void *) &cnfMsg , 0 , sizeof( cnfMsg ) ) ;
+    cnfMsg.purpose = htonl( ORDR_CONFIRM ) ;
+    cnfMsg.numFac  = htonl( total ) ;
+    cnfMsg.orderID = htonl( fo->clientOrder ) ;
+    toClient( fo , &cnfMsg ) ;
+}
+
+//------------------------------------------------------------
+//  A new order from a client: split it and pass the shares on
+//------------------------------------------------------------
+void handleRequest( struct sockaddr_in *from , msgBuf *req )
+{
+    unsigned  clientOrder = ntohl( req->orderID ) ;
+    fanout_t *fo = NULL ;
+
+    // A repeat is a retransmit, as at the factory: confirm it again once
+    // the back-ends have, and until then let the first request run its course
+    if ( ( fo = findByClient( from , clientOrder ) ) != NULL ) {
+        if ( fo->state == FO_RUNNING ) {
+            sendConfirm( fo ) ;
+            printf( "COORDINATOR: client order %u confirmed again\n" , clientOrder ) ;
+        }
+        return ;
+    }
+    for ( int i = 0 ; i < MAXFANOUT && fo == NULL ; i++ )
+        if ( fanouts[ i ].state == FO_FREE )
+            fo = &fanouts[ i ] ;
+    if ( fo == NULL ) {
+        printf( "COORDINATOR: at its limit of %d orders in flight, rejecting\n" , MAXFANOUT ) ;
+        replyProtocolErr( from , clientOrder ) ;
+        return ;
+    }
+
+    memset( fo , 0 , sizeof( *fo ) ) ;
+    fo->state       = FO_CONFIRMING ;
+    fo->id          = ++lastID ;
+    fo->client      = *from ;
+    fo->clientOrder = clientOrder ;
+    fo->orderSize   = ntohl( req->orderSize ) ;
+    fo->deadlineUs  = nowUs() + replyMs * 1000LL ;
+    splitOrder( fo ) ;
+    ordersIn++ ;
+
+    printf( "COORDINATOR: order #%u ( client order %u ) of %u parts split as" , fo->id , clientOrder , fo->orderSize ) ;
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->involved & ( 1u << b ) ) {
+            toBackend( b , REQUEST_MSG , fo->id , fo->share[ b ] ) ;
+            printf( " %u@%s" , fo->share[ b ] , backends[ b ].name ) ;
+        }
+    puts( "" ) ;
+}
+
+//------------------------------------------------------------
+//  A client withdraws an order: cancel it everywhere and
+//  confirm once every back-end has, with the summed counts
+//------------------------------------------------------------
+void handleCancel( struct sockaddr_in *from , msgBuf *req )
+{
+    fanout_t *fo = findByClient( from , ntohl( req->orderID ) ) ;
+
+    if ( fo == NULL ) {
+        // Unknown ( e.g. already completed ): confirmed with zero counts, like the factory does
+        msgBuf cnfMsg ;
+        memset( (void *) &cnfMsg , 0 , sizeof( cnfMsg ) ) ;
+        cnfMsg.purpose = htonl( CANCEL_CONFIRM ) ;
+        cnfMsg.orderID = req->orderID ;
+        if ( sendto( cliSd , (void *) &cnfMsg , sizeof( cnfMsg ) , 0 , (SA *) from , sizeof( *from ) ) < 0 )
+            err_sys( "Error sending the cancel confirmation message" ) ;
+        return ;
+    }
+    if ( fo->state == FO_CANCELLING )
+        return ;
+
+    fo->state      = FO_CANCELLING ;
+    fo->replied    = 0 ;
+    fo->deadlineUs = nowUs() + replyMs * 1000LL ;
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->involved & ( 1u << b ) )
+            toBackend( b , CANCEL_MSG , fo->id , 0 ) ;
+}
+
+//------------------------------------------------------------
+//  Send the client its aggregate Cancel Confirmation
+//------------------------------------------------------------
+void finishCancel( fanout_t *fo )
+{
+    msgBuf cnfMsg ;
+    memset( (void *) &cnfMsg , 0 , sizeof( cnfMsg ) ) ;
+    cnfMsg.purpose   = htonl( CANCEL_CONFIRM ) ;
+    cnfMsg.orderID   = htonl( fo->clientOrder ) ;
+    cnfMsg.orderSize = htonl( fo->orderSize ) ;
+    cnfMsg.partsMade = htonl( fo->cnclMade ) ;
+    toClient( fo , &cnfMsg ) ;
+
+    printf( "COORDINATOR: order #%u ( client order %u ) CANCELLED after %u of %u parts\n"
+          , fo->id , fo->clientOrder , fo->cnclMade , fo->orderSize ) ;
+    fo->state = FO_FREE ;
+    ordersCancelled++ ;
+}
+
+void checkDone( fanout_t *fo ) ;
+
+//------------------------------------------------------------
+//  Every back-end confirmed its share: number the lines and
+//  confirm the whole order to the client
+//------------------------------------------------------------
+void confirmOrder( fanout_t *fo )
+{
+    unsigned total = 0 ;
+
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->involved & ( 1u << b ) ) {
+            fo->offset[ b ]    = total ;
+            fo->linesLeft[ b ] = fo->numFac[ b ] ;
+            total             += fo->numFac[ b ] ;
+        }
+
+    sendConfirm( fo ) ;
+    fo->confirmed  = 1 ;
+    fo->state      = FO_RUNNING ;
+    fo->deadlineUs = nowUs() + idleMs * 1000LL ;
+
+    printf( "COORDINATOR: order #%u ( client order %u ) confirmed on %u lines\n" , fo->id , fo->clientOrder , total ) ;
+
+    // Reports that arrived before the last confirmation
+    for ( int i = 0 ; i < fo->numHeld ; i++ )
+        relayReport( fo , fo->held[ i ].b , &fo->held[ i ].m ) ;
+    fo->numHeld = 0 ;
+    checkDone( fo ) ;
+}
+
+//------------------------------------------------------------
+//  The order is done once every line of every back-end has
+//  sent its completion
+//------------------------------------------------------------
+void checkDone( fanout_t *fo )
+{
+    if ( fo->state != FO_RUNNING )
+        return ;
+    for ( int b = 0 ; b < numBackends ; b++ )
+        if ( fo->linesLeft[ b ] > 0 )
+            return ;
+
+    printf( "COORDINATOR: order #%u ( client order %u ) of %u parts COMPLETED\n" , fo->id , fo->clientOrder , fo->orderSize ) ;
+    fo->state = FO_FREE ;
+    ordersDone++ ;
+}
+
+//------------------------------------------------------------
+//  One message from back-end 'b'
+//------------------------------------------------------------
+void handleBackend( int b , msgBuf *m )
+{
+    uint32_t  bit = 1u << b ;
+
+    fanout_t *fo = findByID( ntohl( m->orderID ) ) ;
+    if ( fo == NULL || ! ( fo->involved & bit ) )
+        return ;            // late news about an order we are done with
+
+    switch ( ntohl( m->purpose ) )
+    {
+      case PROTOCOL_ERR:
+        // The back-end rejected its share, or is shutting down
+        printf( "COORDINATOR: back-end %s sent a Protocol Error\n" , backends[ b ].name ) ;
+        failOrder( fo , "a back-end gave up on it" ) ;
+        break ;
+
+      case ORDR_CONFIRM:
+        if ( fo->state != FO_CONFIRMING )
+            break ;
+        fo->numFac[ b ] = ntohl( m->numFac ) ;
+        fo->replied    |= bit ;
+        if ( fo->replied == fo->involved )
+            confirmOrder( fo ) ;
+        break ;
+
+      case PRODUCTION_MSG:
+      case COMPLETION_MSG:
+        if ( fo->confirmed )
+            relayReport( fo , b , m ) ;
+        else if ( fo->numHeld < MAXHELD ) {
+            fo->held[ fo->numHeld ].b = b ;
+            fo->held[ fo->numHeld ].m = *m ;
+            fo->numHeld++ ;
+        }
+        else {
+            // Dropping it would leave the client short of reports for good
+            failOrder( fo , "too many reports before every back-end confirmed" ) ;
+            break ;
+        }
+        checkDone( fo ) ;
+        break ;
+
+      case CANCEL_CONFIRM:
+        if ( fo->state != FO_CANCELLING || ( fo->replied & bit ) )
+            break ;
+        // A back-end that already finished its share no longer knows the order
+        fo->cnclMade += ntohl( m->partsMade ) > fo->made[ b ] ? ntohl( m->partsMade ) : fo->made[ b ] ;
+        fo->replied  |= bit ;
+        if ( fo->replied == fo->involved )
+            finishCancel( fo ) ;
+        break ;
+    }
+}
+
+//------------------------------------------------------------
+//  Orders whose back-ends did not answer in time. A running
+//  order that has gone quiet lost a back-end, or a completion.
+//------------------------------------------------------------
+void checkDeadlines( void )
+{
+    long long now = nowUs() ;
+
+    for ( int i = 0 ; i < MAXFANOUT ; i++ )
+    {
+        fanout_t *fo = &fanouts[ i ] ;
+        if ( fo->state == FO_CONFIRMING && now >= fo->deadlineUs )
+            failOrder( fo , "no confirmation from every back-end" ) ;
+        else if ( fo->state == FO_RUNNING && now >= fo->deadlineUs )
+            failOrder( fo , "no report from the back-ends in time" ) ;
+        else if ( fo->state == FO_CANCELLING && now >= fo->deadlineUs )
+            finishCancel( fo ) ;    // confirm with what we know
+    }
+}
+
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    int    opt ;
+    static char buf[ MAXDGRAM ] ;
+
+    while ( ( opt = getopt( argc , argv , "t:i:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+          case 't':  replyMs = atoi( optarg ) ;   break ;   // back-end answer timeout
+          case 'i':  idleMs  = atoi( optarg ) ;   break ;   // longest gap between reports
+
+          default:
+            argc = 0 ;      // print the usage below
+            break ;
+        }
+    }
+
+    if ( argc - optind < 2 || argc - optind - 1 > MAXBACKENDS || replyMs < PROBE_TRIES || idleMs <= 0 )
+    {
+        printf( "COORDINATOR Usage: %s [-t replyTimeoutMs] [-i idleTimeoutMs] <listenPort> <FactoryServerIP:port> ...\n"
+                "   up to %d factory servers\n" , argv[0] , MAXBACKENDS ) ;
+        exit( 1 ) ;
+    }
+    unsigned short  listenPort = (unsigned short) atoi( argv[optind] ) ;
+
+    sigactionWrapper( SIGINT , stopCoordinator ) ;
+    sigactionWrapper( SIGTERM , stopCoordinator ) ;
+
+    // One connected socket per back-end
+    for ( int i = optind + 1 ; i < argc ; i++ )
+    {
+        backend_t *be    = &backends[ numBackends++ ] ;
+        char      *colon = strrchr( argv[i] , ':' ) ;
+
+        snprintf( be->name , IPSTRLEN , "%s" , argv[i] ) ;
+        memset( (void *) &be->addr , 0 , sizeof( be->addr ) ) ;
+        be->addr.sin_family = AF_INET ;
+        if ( colon == NULL || ( *colon = '\0' , inet_pton( AF_INET , argv[i] , &be->addr.sin_addr.s_addr ) != 1 ) ) {
+            printf( "COORDINATOR: '%s' is not an IP:port pair\n" , be->name ) ;
+            exit( 1 ) ;
+        }
+        be->addr.sin_port = htons( (unsigned short) atoi( colon + 1 ) ) ;
+
+        be->sd = socket( AF_INET , SOCK_DGRAM , 0 ) ;
+        if ( be->sd < 0 )
+            err_sys( "Couldn't create a back-end UDP socket" ) ;
+        if ( connect( be->sd , (SA *) &be->addr , sizeof( be->addr ) ) < 0 )
+            err_sys( "Couldn't connect a back-end UDP socket" ) ;
+    }
+
+    probeBackends() ;
+    if ( totalRate == 0 )
+        err_quit( "COORDINATOR: no back-end answered\n" ) ;
+
+    // The socket procurement clients talk to
+    struct sockaddr_in  me ;
+    cliSd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (cliSd < 0) {
+        err_sys("Couldn't create a UDP socket");
+    }
+    memset( (void *) &me, 0, sizeof(me));
+    me.sin_family = AF_INET;
+    me.sin_port = htons(listenPort);
+    me.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(cliSd, (SA *) &me, sizeof(me)) < 0) {
+        err_sys("Couldn't bind the socket to the coordinator port");
+    }
+    printf( "COORDINATOR: serving port %d with %d back-ends making %.1f parts/sec in total\n"
+          , listenPort , numBackends , totalRate ) ;
+    fflush( stdout ) ;
+
+    while ( ! done )
+    {
+        struct pollfd fds[ MAXBACKENDS + 1 ] ;
+        fds[ 0 ].fd = cliSd ;
+        fds[ 0 ].events = POLLIN ;
+        for ( int b = 0 ; b < numBackends ; b++ ) {
+            fds[ b+1 ].fd = backends[ b ].sd ;
+            fds[ b+1 ].events = POLLIN ;
+        }
+
+        if ( poll( fds , numBackends + 1 , 100 ) < 0 ) {
+            if ( errno == EINTR )
+                continue ;
+            err_sys( "poll failed" ) ;
+        }
+
+        // From a client
+        if ( fds[ 0 ].revents & POLLIN )
+        {
+            struct sockaddr_in  from ;
+            socklen_t  addrLen = sizeof( from ) ;
+            ssize_t    n = recvfrom( cliSd , buf , sizeof( buf ) , 0 , (SA *) &from , &addrLen ) ;
+            msgBuf    *m = (msgBuf *) buf ;
+
+            if ( n >= (ssize_t) MSG_MIN_LEN && n < (ssize_t) sizeof( msgBuf ) )
+                m->orderID = 0 ;                    // an older client's message
+
+            if ( n < (ssize_t) MSG_MIN_LEN )
+                replyProtocolErr( &from , 0 ) ;     // too short
+            else if ( ntohl( m->purpose ) == REQUEST_MSG )
+                handleRequest( &from , m ) ;
+            else if ( ntohl( m->purpose ) == CANCEL_MSG )
+                handleCancel( &from , m ) ;
+            else
+                replyProtocolErr( &from , 0 ) ;
+        }
+
+        // From the back-ends
+        for ( int b = 0 ; b < numBackends ; b++ )
+        {
+            if ( ! ( fds[ b+1 ].revents & ( POLLIN | POLLERR ) ) )
+                continue ;
+            ssize_t n = recv( backends[ b ].sd , buf , sizeof( buf ) , 0 ) ;
+            if ( n >= (ssize_t) sizeof( msgBuf ) )
+                handleBackend( b , (msgBuf *) buf ) ;
+        }
+
+        checkDeadlines() ;
+        fflush( stdout ) ;
+    }
+
+    // Withdraw whatever is still in flight
+    for ( int i = 0 ; i < MAXFANOUT ; i++ )
+        if ( fanouts[ i ].state != FO_FREE )
+            failOrder( &fanouts[ i ] , "the coordinator is shutting down" ) ;
+
+    printf( "\nCOORDINATOR: %lu orders received , %lu completed , %lu cancelled , %lu failed\n"
+          , ordersIn , ordersDone , ordersCancelled , ordersFailed ) ;
+    return 0 ;
+}
@@ -19,9 +19,13 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <pthread.h>
+#include <stdint.h>
 
 #include "wrappers.h"
 #include "message.h"
+#include "journal.h"
+#include "session.h"
+#include "clients.h"
 
 #define MAXSTR     200
 #define IPSTRLEN    50
@@ -33,6 +37,12 @@ int minimum( int a , int b)
     return ( a <= b ? a : b ) ; 
 }
 
+// For part counts, which may exceed INT_MAX
+uint32_t minimumU( uint32_t a , uint32_t b )
+{
+    return ( a <= b ? a : b ) ;
+}
+
 void subFactory( int factoryID , int myCapacity , int myDuration ) ;
 
 void factLog( char *str )
@@ -43,14 +53,60 @@ void factLog( char *str )
 
 /*-------------------------------------------------------*/
 
-// Global Variable for Future Thread to Shared
-int   remainsToMake , // Must be protected by a Mutex
-      actuallyMade ;  // Actually manufactured items
+// Shared by the receiving thread and all factory lines.
+// Every session field, the client table with its run queues
+// and the journal are protected by remains_mutex.
+sessStore_t     sessions ;
+unsigned        maxSessions = 1 << 20 ;     // fixed memory budget, set with -s
+
+clientTable_t   clients ;                   // per-client share and rate limits
+char           *ratesPath = NULL ;          // set with -r
 
+int   numLines = 1 ;        // factory line threads shared by all orders
 
-int   numActiveFactories = 1 , orderSize ;
+#define LINE_CAPACITY        50     // parts per iteration of a non-adaptive line
+#define LINE_DURATION       350     // mSec per iteration of a non-adaptive line
+
+// Adaptive capacity ( -a min:max[:targetMs] ). Each iteration then takes
+// LINE_SETUP_MS plus LINE_MS_PER_PART per part, so bigger batches give more
+// throughput but make every report wait longer.
+#define LINE_SETUP_MS       100
+#define LINE_MS_PER_PART      5
+
+int   adaptive = 0 ,        // 0 = every line makes LINE_CAPACITY parts per LINE_DURATION
+      minCapacity = 10 , maxCapacity = 200 ,
+      targetIterMs = 1000 ; // an iteration should not take longer than this
+
+unsigned long  backlog = 0 ;    // unclaimed parts over all orders
 
 pthread_mutex_t remains_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  work_cond ;     // a run queue became non-empty ( on CLOCK_MONOTONIC, see main )
+
+typedef struct {
+    pthread_cond_t  wake ;      // signalled when this line's order is cancelled
+    sessHandle_t    order ;     // order being made right now, SESS_NIL if none
+} lineState_t ;
+
+lineState_t    *lines ;     // one per factory line, indexed by factoryID-1
+
+#define JRNL_CHECKPOINT_RATIO  4     // checkpoint once the log is this many times its summary
+
+journal_t  jrnl ;                   // Crash-recovery log of accepted orders
+char      *jrnlPath = NULL ;        // default: factory.<port>.journal
+unsigned   lastOrderID = 0 ;        // Highest order ID ever handed out
+
+struct timespec startTime ;         // session timers count from here
+
+#define RECV_BATCH  64      // requests read back to back that can share one journal sync
+
+typedef struct {
+    struct sockaddr_in  to ;
+    msgBuf              reply ;     // ORDR_CONFIRM , or PROTOCOL_ERR when rejected
+    sessHandle_t        start ;     // new order to hand to the lines , SESS_NIL if none
+} pendingReply_t ;
+
+pendingReply_t  pending[ RECV_BATCH ] ;     // only the receiving thread uses these
+int             numPending = 0 ;
 
 int   sd ;      // Server socket descriptor
 struct sockaddr_in  
@@ -58,13 +114,108 @@ struct sockaddr_in
              clntSkt;       /* remote client's socket       */
 
 //------------------------------------------------------------
-//  Handle Ctrl-C or KILL 
+//  mSec elapsed since the server started
+//------------------------------------------------------------
+uint32_t nowMs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return ( ts.tv_sec - startTime.tv_sec ) * 1000
+         + ( ts.tv_nsec - startTime.tv_nsec ) / 1000000 ;
+}
+
+//------------------------------------------------------------
+//  Absolute CLOCK_MONOTONIC deadline 'usec' from now, for
+//  pthread_cond_timedwait() on the lines' condition variables,
+//  so setting the wall clock cannot stretch or cut a wait
+//------------------------------------------------------------
+void deadlineIn( struct timespec *until , long long usec )
+{
+    clock_gettime( CLOCK_MONOTONIC , until ) ;
+    until->tv_sec  += usec / 1000000 ;
+    until->tv_nsec += ( usec % 1000000 ) * 1000 ;
+    if ( until->tv_nsec >= 1000000000L ) {
+        until->tv_sec++ ;
+        until->tv_nsec -= 1000000000L ;
+    }
+}
+
+//------------------------------------------------------------
+//  Commit the journal without holding up the lines: the msync
+//  runs with remains_mutex released.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+void commitJournal( int force )
+{
+    pthread_mutex_unlock( &remains_mutex ) ;
+    journalCommit( &jrnl , force ) ;
+    pthread_mutex_lock( &remains_mutex ) ;
+}
+
+//------------------------------------------------------------
+//  A line's wait on 'cond' until 'until' ( NULL = no limit ).
+//  The journal has no flusher of its own, so the wait is cut
+//  short whenever the pending group is due, and the group is
+//  synced then; otherwise the last claims before a quiet spell
+//  would never reach the disk.
+//  Returns ETIMEDOUT only once 'until' has passed.
+//  Called with remains_mutex held; like any wait, it lets go of
+//  it meanwhile, including for the msync.
+//------------------------------------------------------------
+int lineWait( pthread_cond_t *cond , const struct timespec *until )
+{
+    long long        dueUs = journalDueUs( &jrnl ) ;
+    struct timespec  flushAt ;
+    int              rc ;
+
+    if ( dueUs >= 0 )
+        deadlineIn( &flushAt , dueUs ) ;
+
+    if ( dueUs >= 0 && ( until == NULL || flushAt.tv_sec < until->tv_sec
+                         || ( flushAt.tv_sec == until->tv_sec && flushAt.tv_nsec < until->tv_nsec ) ) )
+    {
+        rc = pthread_cond_timedwait( cond , &remains_mutex , &flushAt ) ;
+        commitJournal( 0 ) ;
+        return rc == ETIMEDOUT ? 0 : rc ;     // a flush stop, not the caller's timeout
+    }
+
+    rc = until == NULL ? pthread_cond_wait( cond , &remains_mutex )
+                       : pthread_cond_timedwait( cond , &remains_mutex , until ) ;
+    commitJournal( 0 ) ;
+    return rc ;
+}
+
+//------------------------------------------------------------
+//  Fill in a socket address from a session's client
+//------------------------------------------------------------
+void sessAddr( const session_t *s , struct sockaddr_in *a )
+{
+    memset( (void *) a, 0, sizeof(*a));
+    a->sin_family = AF_INET;
+    a->sin_addr.s_addr = s->clientIP;
+    a->sin_port = s->clientPort;
+}
+
+//------------------------------------------------------------
+//  Handle Ctrl-C or KILL. SIGINT and SIGTERM are blocked in
+//  every thread and taken here with sigwait(), so the goodbye
+//  runs as an ordinary thread: it holds remains_mutex while it
+//  walks the sessions and closes the journal, and keeps it
+//  until exit() so no line appends to a closed journal.
 //------------------------------------------------------------
-void goodbye(int sig) 
+void *goodbyeThread( void *arg )
 {
+    sigset_t  *stopSigs = (sigset_t *) arg ;
+    int        sig ;
+
+    if ( sigwait( stopSigs , &sig ) != 0 )
+        err_sys( "sigwait failed" ) ;
+
+    pthread_mutex_lock( &remains_mutex ) ;
     fflush(stdout);
            
     msgBuf byeMsg;
+    memset( (void *) &byeMsg, 0, sizeof(byeMsg));
     byeMsg.purpose = htonl(PROTOCOL_ERR);
     switch( sig ) {
         case SIGTERM:
@@ -76,24 +227,475 @@ void goodbye(int sig)
             break ;
     }
 
-    if (sendto(sd, &byeMsg, sizeof(byeMsg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
-        err_sys("Error sending error message");
+    // Tell every client with an order in flight
+    struct sockaddr_in  to ;
+    for ( uint32_t b = 0 ; b <= sessions.hashMask ; b++ )
+    {
+        if ( sessions.hash[ b ] == SESS_NIL )
+            continue ;
+        sessAddr( &sessions.slots[ sessions.hash[ b ] ] , &to ) ;
+        byeMsg.orderID = htonl( sessions.slots[ sessions.hash[ b ] ].clientOrder ) ;
+        if (sendto(sd, &byeMsg, sizeof(byeMsg), 0, (SA *) &to, sizeof(to)) < 0) {
+            err_sys("Error sending error message");
+        }
     }
-    pthread_mutex_destroy(&remains_mutex);
+    journalClose( &jrnl ) ;
     close( sd ) ;
     exit( 0 ) ;
 }
 
+//------------------------------------------------------------
+//  Rebuild in-flight orders from one journal record
+//------------------------------------------------------------
+void recoverRecord( const jrnlRec *r , void *arg )
+{
+    if ( r->orderID > lastOrderID )
+        lastOrderID = r->orderID ;
+
+    sessHandle_t h = sessFind( &sessions , r->clientIP , r->clientPort , r->clientOrder ) ;
+    session_t   *s = sessGet( &sessions , h ) ;
+
+    switch ( r->type ) {
+        case JRNL_ACCEPT:
+            if ( s == NULL ) {
+                h = sessAlloc( &sessions , r->clientIP , r->clientPort , r->clientOrder ) ;
+                if ( ( s = sessGet( &sessions , h ) ) == NULL )
+                    err_quit( "Journal holds more orders than the session store\n" ) ;
+            }
+            s->orderID = r->orderID ;
+            s->ordered += r->amount ;
+            s->remains += r->amount ;
+            break ;
+
+        case JRNL_CLAIM:
+            if ( s != NULL && s->orderID == r->orderID ) {
+                s->remains -= minimumU( s->remains , r->amount ) ;
+                s->made    += r->amount ;
+                s->iters++ ;
+            }
+            break ;
+
+        case JRNL_COMPLETE:
+        case JRNL_CANCEL:
+            if ( s != NULL && s->orderID == r->orderID )
+                sessFree( &sessions , h ) ;
+            break ;
+    }
+}
+
+//------------------------------------------------------------
+//  Sum up every order in flight for a journal checkpoint: what
+//  was ordered, and what was made and reported so far. Batches
+//  being made now are not in the log yet, just as before.
+//  Cancelled orders are left out; they are gone once replayed.
+//------------------------------------------------------------
+void checkpointOrders( journal_t *j , void *arg )
+{
+    for ( uint32_t b = 0 ; b <= sessions.hashMask ; b++ )
+    {
+        uint32_t idx = sessions.hash[ b ] ;
+        if ( idx == SESS_NIL )
+            continue ;
+        session_t *s = &sessions.slots[ idx ] ;
+        if ( s->flags & SESS_CANCELLED )
+            continue ;
+
+        journalAppend( j, JRNL_ACCEPT, s->orderID, s->clientIP, s->clientPort,
+                       s->clientOrder, s->ordered ) ;
+        if ( s->made > 0 )
+            journalAppend( j, JRNL_CLAIM, s->orderID, s->clientIP, s->clientPort,
+                           s->clientOrder, s->made ) ;
+    }
+}
+
+//------------------------------------------------------------
+//  Keep the journal from growing without bound. With no order in
+//  flight it is simply emptied; otherwise it is replaced by a
+//  checkpoint once it is several times the size of one.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+void trimJournal( void )
+{
+    size_t summary = (size_t) sessions.live * 2 * sizeof( jrnlRec ) ;
+
+    if ( jrnl.tail < JRNL_CHUNK )
+        return ;
+    if ( sessions.live == 0 )
+        journalReset( &jrnl ) ;
+    else if ( jrnl.tail >= JRNL_CHECKPOINT_RATIO * summary )
+        journalCheckpoint( &jrnl , checkpointOrders , NULL ) ;
+}
+
+//------------------------------------------------------------
+//  Release an order's session once it is done or cancelled.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+void releaseOrder( sessHandle_t h )
+{
+    sessFree( &sessions , h ) ;
+    trimJournal() ;
+}
+
+//------------------------------------------------------------
+//  An order has nothing left to claim and no busy lines.
+//  Report it complete and release its session.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+void finishOrder( sessHandle_t h )
+{
+    char    strBuff[ MAXSTR ] ;
+    char    ipStr[ IPSTRLEN ] ;
+    struct sockaddr_in  to ;
+    session_t *s = sessGet( &sessions , h ) ;
+
+    // One Completion Message per line, as promised by the Order Confirmation
+    sessAddr( s , &to ) ;
+    for ( int i = 1 ; i <= numLines ; i++ )
+    {
+        msgBuf cmpMsg;
+        cmpMsg.facID = htonl(i);
+        cmpMsg.orderID = htonl(s->clientOrder);
+        cmpMsg.purpose = htonl(COMPLETION_MSG);
+
+        if (sendto(sd, (void *) &cmpMsg, sizeof(cmpMsg), 0, (SA *) &to, sizeof(to)) < 0) {
+            err_sys("Error sending completion message");
+        }
+    }
+
+    // Synced with the next group. Lost in a crash, it only means the
+    // order is completed, and its Completion Messages sent, once more.
+    journalAppend( &jrnl, JRNL_COMPLETE, s->orderID, s->clientIP, s->clientPort,
+                   s->clientOrder, s->made ) ;
+
+    inet_ntop( AF_INET, (void *) &to.sin_addr.s_addr, ipStr, IPSTRLEN ) ;
+    snprintf( strBuff , MAXSTR , ">>> Order #%-5u ( client order %u ) for IP %s Port %d: made %-5u parts in %-4u iterations over %u mSec\n"
+          , s->orderID , s->clientOrder , ipStr , ntohs( to.sin_port ) , s->made , s->iters , nowMs() - s->acceptMs ) ;
+    factLog( strBuff ) ;
+
+    releaseOrder( h ) ;
+}
+
+//------------------------------------------------------------
+//  Reply to the current client with a Protocol Error about
+//  one of its orders ( 0 when it is not about an order )
+//------------------------------------------------------------
+void sendProtocolErr( unsigned clientOrder )
+{
+    msgBuf errMsg;
+    memset( (void *) &errMsg, 0, sizeof(errMsg));
+    errMsg.purpose = htonl(PROTOCOL_ERR);
+    errMsg.orderID = htonl(clientOrder);
+    if (sendto(sd, (void *)&errMsg, sizeof(errMsg), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
+        err_sys("Error sending the protocol error message");
+    }
+    printf("\n\nFACTORY sent a Protocol Error to the client\n");
+}
+
+//------------------------------------------------------------
+//  Accept one order from the current client and journal it.
+//  The record is never synced here: the caller commits the
+//  journal ( once for a batch of requests ), confirms, then queues the
+//  order with startOrder(). Returns SESS_NIL when the session
+//  store is full.
+//  A request for an order that is still in flight is a
+//  retransmit ( the client lost our confirmation, or the network
+//  duplicated its request ): it returns the order's handle with
+//  *retransmit set, and nothing is added or journaled. That
+//  includes an order cancelled since, until the lines let go of
+//  it; the caller checks SESS_CANCELLED.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+sessHandle_t acceptOrder( unsigned clientOrder , unsigned orderSize , int *retransmit )
+{
+    sessHandle_t h = sessFind( &sessions , clntSkt.sin_addr.s_addr , clntSkt.sin_port , clientOrder ) ;
+    session_t   *s = sessGet( &sessions , h ) ;
+
+    *retransmit = s != NULL ;
+    if ( s != NULL )
+        return h ;
+
+    // A new order
+    h = sessAlloc( &sessions , clntSkt.sin_addr.s_addr , clntSkt.sin_port , clientOrder ) ;
+    if ( ( s = sessGet( &sessions , h ) ) == NULL )
+        return SESS_NIL ;
+
+    s->orderID  = ++lastOrderID ;
+    s->acceptMs = nowMs() ;
+    s->client   = clientFor( &clients , s->clientIP ) ;
+    s->ordered  = orderSize ;
+    s->remains  = orderSize ;
+    backlog    += orderSize ;
+
+    journalAppend( &jrnl, JRNL_ACCEPT, s->orderID, s->clientIP, s->clientPort,
+                   clientOrder, orderSize ) ;
+    return h ;
+}
+
+//------------------------------------------------------------
+//  Hand a confirmed order to the factory lines.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+void startOrder( sessHandle_t h )
+{
+    session_t *s = sessGet( &sessions , h ) ;
+
+    if ( s->remains > 0 )
+        clientEnqueue( &clients , &sessions , h ) ;
+    else if ( s->busyLines == 0 )
+        finishOrder( h ) ;          // an empty order is complete right away
+}
+
+//------------------------------------------------------------
+//  A single order: one REQUEST_MSG , one ORDR_CONFIRM.
+//  The confirmation waits in pending[] until flushReplies(), so
+//  the requests that arrive together share one journal sync.
+//------------------------------------------------------------
+void handleRequest( msgBuf *req )
+{
+    pendingReply_t *p = &pending[ numPending++ ] ;
+    int             retransmit ;
+
+    memset( (void *) &p->reply, 0, sizeof(p->reply));
+    p->to            = clntSkt ;
+    p->reply.orderID = req->orderID;
+
+    pthread_mutex_lock(&remains_mutex);
+    sessHandle_t h = acceptOrder( ntohl(req->orderID) , ntohl(req->orderSize) , &retransmit ) ;
+    session_t   *s = sessGet( &sessions , h ) ;
+
+    // Cancelled since: the client missed our cancel confirmation, so repeat that
+    if ( retransmit && ( s->flags & SESS_CANCELLED ) )
+    {
+        p->start           = SESS_NIL ;
+        p->reply.purpose   = htonl(CANCEL_CONFIRM);
+        p->reply.orderSize = htonl(s->ordered);
+        p->reply.partsMade = htonl(s->made);
+        pthread_mutex_unlock(&remains_mutex);
+        printf("\nFACTORY will confirm the cancel of a repeated request again\n");
+        return ;
+    }
+    pthread_mutex_unlock(&remains_mutex);
+
+    p->start = retransmit ? SESS_NIL : h ;
+    if ( h == SESS_NIL )
+    {
+        printf("\nFACTORY is at its limit of %u orders, rejecting\n", maxSessions);
+        p->reply.purpose = htonl(PROTOCOL_ERR);
+        return ;
+    }
+
+    // The same confirmation again for a retransmit
+    p->reply.numFac  = htonl(numLines);
+    p->reply.purpose = htonl(ORDR_CONFIRM);
+    if ( retransmit )
+        printf("\nFACTORY will confirm a repeated request again\n");
+}
+
+//------------------------------------------------------------
+//  Make the orders accepted since the last call durable with a
+//  single journal sync, then confirm them and hand them to the
+//  lines. Runs before any other message is handled, so a cancel
+//  never overtakes the order it is about.
+//------------------------------------------------------------
+void flushReplies( void )
+{
+    if ( numPending == 0 )
+        return ;
+
+    // The orders must be durable before we confirm them
+    journalCommit( &jrnl , 1 ) ;
+
+    // Send the confirmations before any line can report on these orders
+    for ( int i = 0 ; i < numPending ; i++ )
+        if (sendto(sd, (void *)&pending[ i ].reply, sizeof(msgBuf), 0, (SA * ) &pending[ i ].to, sizeof(pending[ i ].to)) < 0) {
+            err_sys("Error sending the order confirmation message");
+        }
+
+    pthread_mutex_lock(&remains_mutex);
+    for ( int i = 0 ; i < numPending ; i++ )
+        if ( pending[ i ].start != SESS_NIL )
+            startOrder( pending[ i ].start ) ;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&remains_mutex);
+
+    printf("\n\nFACTORY sent %d Order Confirmation(s) after one journal commit, the last one " , numPending );
+    printMsg(  & pending[ numPending - 1 ].reply );  puts("");
+    numPending = 0 ;
+}
+
+//------------------------------------------------------------
+//  Many orders in one BULK_REQUEST. They share one journal
+//  commit and one BULK_CONFIRM listing the lines given to each
+//  order ( 0 when the order was rejected ). An order already in
+//  flight from an earlier request is confirmed again, but an ID
+//  repeated within this request is rejected: only one set of
+//  completions would ever be sent for it. So is an order that has
+//  been cancelled since, as no line will ever work on it again.
+//------------------------------------------------------------
+void handleBulkRequest( bulkMsgBuf *req )
+{
+    static bulkMsgBuf    cnfMsg ;               // only the receiving thread gets here
+    static sessHandle_t  handles[ MAXBULK ] ,   // orders to start, SESS_NIL if none
+                         found[ MAXBULK ] ;     // every order named by this request
+    unsigned  n = ntohl( req->numOrders ) , rejected = 0 , repeated = 0 , cancelled = 0 ;
+    int       retransmit ;
+
+    cnfMsg.purpose   = htonl(BULK_CONFIRM);
+    cnfMsg.numOrders = htonl(n);
+
+    pthread_mutex_lock(&remains_mutex);
+
+    for ( unsigned i = 0 ; i < n ; i++ )
+    {
+        sessHandle_t h = acceptOrder( ntohl(req->order[i].orderID) , ntohl(req->order[i].amount) , &retransmit ) ;
+        unsigned     lines = h == SESS_NIL ? 0 : numLines ;
+
+        found[ i ]   = h ;
+        handles[ i ] = retransmit ? SESS_NIL : h ;
+        if ( retransmit && ( sessGet( &sessions , h )->flags & SESS_CANCELLED ) ) {
+            lines = 0 ;
+            cancelled++ ;
+        }
+        for ( unsigned k = 0 ; retransmit && h != SESS_NIL && k < i ; k++ )
+            if ( found[ k ] == h && lines > 0 ) {
+                lines = 0 ;         // named twice in this request
+                repeated++ ;
+                break ;
+            }
+        cnfMsg.order[ i ].orderID = req->order[ i ].orderID ;
+        cnfMsg.order[ i ].amount  = htonl( lines ) ;
+        rejected += h == SESS_NIL ;
+    }
+    pthread_mutex_unlock(&remains_mutex);
+
+    // One group commit makes the whole batch durable before we confirm it
+    journalCommit( &jrnl , 1 ) ;
+
+    if (sendto(sd, (void *)&cnfMsg, BULK_MSG_LEN( n ), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
+        err_sys("Error sending the bulk order confirmation message");
+    }
+
+    pthread_mutex_lock(&remains_mutex);
+    for ( unsigned i = 0 ; i < n ; i++ )
+        if ( handles[ i ] != SESS_NIL )
+            startOrder( handles[ i ] ) ;
+    pthread_cond_broadcast(&work_cond);
+    pthread_mutex_unlock(&remains_mutex);
+
+    printf("\n\nFACTORY sent this Bulk Order Confirmation to the client " );
+    printBulkMsg( & cnfMsg );  puts("");
+    if ( rejected > 0 )
+        printf("FACTORY is at its limit of %u orders, rejected %u of them\n", maxSessions, rejected);
+    if ( repeated > 0 )
+        printf("FACTORY rejected %u order IDs repeated within the request\n", repeated);
+    if ( cancelled > 0 )
+        printf("FACTORY rejected %u orders that were already cancelled\n", cancelled);
+}
+
+//------------------------------------------------------------
+//  Withdraw an order. Its unclaimed parts are dropped at once,
+//  and lines making a batch for it are woken so they can move
+//  on to other orders. The confirmation carries the final count
+//  of parts made; batches cut short are not counted.
+//------------------------------------------------------------
+void handleCancel( msgBuf *req )
+{
+    msgBuf cnfMsg;
+    memset( (void *) &cnfMsg, 0, sizeof(cnfMsg));
+    cnfMsg.purpose = htonl(CANCEL_CONFIRM);
+    cnfMsg.orderID = req->orderID;
+
+    pthread_mutex_lock(&remains_mutex);
+
+    sessHandle_t h = sessFind( &sessions , clntSkt.sin_addr.s_addr , clntSkt.sin_port , ntohl(req->orderID) ) ;
+    session_t   *s = sessGet( &sessions , h ) ;
+
+    // An unknown order ( e.g. already completed ) is confirmed with zero counts
+    if ( s != NULL && ! ( s->flags & SESS_CANCELLED ) )
+    {
+        s->flags  |= SESS_CANCELLED ;
+        backlog   -= s->remains ;
+        s->remains = 0 ;
+
+        journalAppend( &jrnl, JRNL_CANCEL, s->orderID, s->clientIP, s->clientPort,
+                       s->clientOrder, s->made ) ;
+
+        for ( int i = 0 ; i < numLines ; i++ )
+            if ( lines[ i ].order == h )
+                pthread_cond_signal( &lines[ i ].wake ) ;
+
+        cnfMsg.orderSize = htonl(s->ordered);
+        cnfMsg.partsMade = htonl(s->made);
+
+        printf("\n>>> Order #%-5u ( client order %u ) CANCELLED after %u of %u parts\n",
+               s->orderID, s->clientOrder, s->made, s->ordered);
+
+        // Still queued or busy: the last line to let go releases it
+        if ( s->busyLines == 0 && ! ( s->flags & SESS_QUEUED ) )
+            releaseOrder( h ) ;
+    }
+
+    pthread_mutex_unlock(&remains_mutex);
+
+    // The cancel must be durable before we confirm it
+    journalCommit( &jrnl , 1 ) ;
+    if (sendto(sd, (void *)&cnfMsg, sizeof(cnfMsg), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
+        err_sys("Error sending the cancel confirmation message");
+    }
+
+    printf("\n\nFACTORY sent this Cancel Confirmation to the client " );
+    printMsg(  & cnfMsg );  puts("");
+}
+
+//------------------------------------------------------------
+//  Advertise what the lines can make, for a coordinator that
+//  splits orders across several factory servers. An adaptive
+//  line reports its largest batch and the time it takes.
+//------------------------------------------------------------
+void handleCapacityQuery( void )
+{
+    msgBuf infoMsg;
+    memset( (void *) &infoMsg, 0, sizeof(infoMsg));
+    infoMsg.purpose  = htonl(CAPACITY_INFO);
+    infoMsg.numFac   = htonl(numLines);
+    infoMsg.capacity = htonl(adaptive ? maxCapacity : LINE_CAPACITY);
+    infoMsg.duration = htonl(adaptive ? LINE_SETUP_MS + LINE_MS_PER_PART * maxCapacity : LINE_DURATION);
+
+    if (sendto(sd, (void *)&infoMsg, sizeof(infoMsg), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
+        err_sys("Error sending the capacity info message");
+    }
+    printf("\n\nFACTORY sent this Capacity Info to the client " );
+    printMsg(  & infoMsg );  puts("");
+}
+
+//------------------------------------------------------------
+//  Body of a factory line thread
+//------------------------------------------------------------
+void *lineThread( void *arg )
+{
+    subFactory( (int) (intptr_t) arg , LINE_CAPACITY , LINE_DURATION ) ;
+    return NULL ;
+}
+
 /*-------------------------------------------------------*/
 int main( int argc , char *argv[] )
 {
-    sigactionWrapper(SIGTERM, goodbye);
-    sigactionWrapper(SIGINT, goodbye);
+    // Block the stop signals before any thread exists, so that all of
+    // them inherit the mask and only goodbyeThread() ever takes one
+    static sigset_t  stopSigs ;
+    sigemptyset( &stopSigs ) ;
+    sigaddset( &stopSigs , SIGTERM ) ;
+    sigaddset( &stopSigs , SIGINT ) ;
+    if ( pthread_sigmask( SIG_BLOCK , &stopSigs , NULL ) != 0 )
+        err_sys( "pthread_sigmask failed" ) ;
 
     char  *myName = "Kyle Mirra and Akwasi Okyere" ; 
     unsigned short port = 50015 ;      /* service port number  */
     int    N = 1 ;                     /* Num threads serving the client */
     socklen_t     addrLen;          /* from-address length          */
+    int    opt ;
+
+    clock_gettime( CLOCK_MONOTONIC , &startTime ) ;
 
     printf("\nThis is the FACTORY server developed by %s\n\n" , myName ) ;
     char myUserName[30] ;
@@ -103,25 +705,56 @@ int main( int argc , char *argv[] )
     fprintf( stdout , "Logged in as user '%s' on %s\n\n" , myUserName ,  ctime( &now)  ) ;
     fflush( stdout ) ;
 
-	switch (argc) 
+    while ( ( opt = getopt( argc , argv , "j:s:a:r:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+          case 'j':
+            jrnlPath = optarg ;     // journal file to recover from and append to
+            break ;
+
+          case 's':
+            maxSessions = strtoul( optarg , NULL , 10 ) ;   // max concurrent orders
+            break ;
+
+          case 'r':
+            ratesPath = optarg ;    // per-client weights and rate limits
+            break ;
+
+          case 'a':     // lines pick their own capacity within [min,max]
+            adaptive = sscanf( optarg , "%d:%d:%d" , &minCapacity , &maxCapacity , &targetIterMs ) >= 2 ;
+            if ( ! adaptive || minCapacity < 1 || maxCapacity < minCapacity || targetIterMs < 1 ) {
+                printf( "FACTORY: -a expects minCapacity:maxCapacity[:targetIterMs]\n" ) ;
+                exit( 1 ) ;
+            }
+            break ;
+
+          default:
+            printf( "FACTORY Usage: %s [-j journalFile] [-s maxSessions] [-a minCap:maxCap[:targetMs]] [-r ratesFile] [numThreads] [port]\n" , argv[0] );
+            exit( 1 ) ;
+        }
+    }
+
+	switch (argc - optind)
 	{
-      case 1:
+      case 0:
         break ;     // use default port with a single factory thread
       
-      case 2:
-        N = atoi( argv[1] ); // get from command line
+      case 1:
+        N = atoi( argv[optind] ); // get from command line
         port = 50015;            // use this port by default
         break;
 
-      case 3:
-        N    = atoi( argv[1] ) ; // get from command line
-        port = atoi( argv[2] ) ; // use port from command line
+      case 2:
+        N    = atoi( argv[optind] ) ;   // get from command line
+        port = atoi( argv[optind+1] ) ; // use port from command line
         break;
 
       default:
-        printf( "FACTORY Usage: %s [numThreads] [port]\n" , argv[0] );
+        printf( "FACTORY Usage: %s [-j journalFile] [-s maxSessions] [-a minCap:maxCap[:targetMs]] [-r ratesFile] [numThreads] [port]\n" , argv[0] );
         exit( 1 ) ;
     }
+    numLines = N > 0 ? N : 1 ;
 
     // Create the socket
     sd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -146,100 +779,305 @@ int main( int argc , char *argv[] )
     inet_ntop( AF_INET, (void *) & srvrSkt.sin_addr.s_addr , ipStr , IPSTRLEN ) ;
     printf( "Bound socket %d to IP %s Port %d\n" , sd , ipStr , ntohs( srvrSkt.sin_port ) );
     
+    // Reserve the whole session budget up front
+    sessInit( &sessions , maxSessions ) ;
+    printf( "Session store: up to %u concurrent orders at %zu bytes per session ( %.1f MB )\n" ,
+            maxSessions , sessBytesPer( &sessions ) ,
+            maxSessions * (double) sessBytesPer( &sessions ) / ( 1 << 20 ) ) ;
+
+    // Per-client shares, before any order is queued
+    clientsInit( &clients ) ;
+    if ( ratesPath != NULL )
+        printf( "Loaded %d client rate limits from '%s'\n" , clientsLoad( &clients , ratesPath ) , ratesPath ) ;
+
+    // Replay the journal to recover the orders that were in flight at the last crash.
+    // Each port gets its own journal, so servers sharing a directory stay apart.
+    char  defaultPath[ MAXSTR ] ;
+    if ( jrnlPath == NULL ) {
+        snprintf( defaultPath , MAXSTR , "factory.%d.journal" , port ) ;
+        jrnlPath = defaultPath ;
+    }
+    struct timespec t0 , t1 ;
+    clock_gettime( CLOCK_MONOTONIC , &t0 ) ;
+    journalOpen( &jrnl , jrnlPath ) ;
+    size_t nRecs = journalReplay( &jrnl , recoverRecord , NULL ) ;
+    clock_gettime( CLOCK_MONOTONIC , &t1 ) ;
+    printf( "Replayed %zu journal records from '%s' in %.1f mSec\n" , nRecs , jrnlPath ,
+            ( t1.tv_sec - t0.tv_sec ) * 1e3 + ( t1.tv_nsec - t0.tv_nsec ) / 1e6 ) ;
+
+    if ( sessions.live == 0 )
+        journalReset( &jrnl ) ;     // nothing in flight, start a fresh log
+    else
+    {
+        printf( "Resuming %u orders in flight\n" , sessions.live ) ;
+        for ( uint32_t b = 0 ; b <= sessions.hashMask ; b++ )
+        {
+            uint32_t idx = sessions.hash[ b ] ;
+            if ( idx == SESS_NIL )
+                continue ;
+            session_t    *s = &sessions.slots[ idx ] ;
+            sessHandle_t  h = sessFind( &sessions , s->clientIP , s->clientPort , s->clientOrder ) ;
+            s->acceptMs = nowMs() ;
+            s->client   = clientFor( &clients , s->clientIP ) ;
+            backlog += s->remains ;
+            if ( s->remains > 0 )
+                clientEnqueue( &clients , &sessions , h ) ;
+            else {
+                finishOrder( h ) ;      // all made, only the completion was lost
+                b-- ;                   // the deletion may have shifted a later entry here
+            }
+        }
+    }
+
+    // Recovery is done; from here on a stop signal says goodbye
+    pthread_t tid ;
+    Pthread_create( &tid , NULL , goodbyeThread , (void *) &stopSigs ) ;
+    Pthread_detach( tid ) ;
+
+    // Start the factory lines. They pick work from the clients' run queues.
+    // Their timed waits use deadlineIn(), which reads CLOCK_MONOTONIC.
+    pthread_condattr_t  monotonic ;
+    pthread_condattr_init( &monotonic ) ;
+    pthread_condattr_setclock( &monotonic , CLOCK_MONOTONIC ) ;
+    pthread_cond_init( &work_cond , &monotonic ) ;
+
+    lines = calloc( numLines , sizeof( lineState_t ) ) ;
+    if ( lines == NULL )
+        err_quit( "Out of memory for the factory lines\n" ) ;
+    for ( int i = 1 ; i <= numLines ; i++ )
+    {
+        pthread_cond_init( &lines[ i-1 ].wake , &monotonic ) ;
+        lines[ i-1 ].order = SESS_NIL ;
+
+        Pthread_create( &tid , NULL , lineThread , (void *) (intptr_t) i ) ;
+        Pthread_detach( tid ) ;
+    }
+    pthread_condattr_destroy( &monotonic ) ;
+    printf( "Started %d factory lines\n" , numLines ) ;
+    if ( adaptive )
+        printf( "Lines adapt their capacity between %d and %d parts, iterations up to %d mSec\n" ,
+                minCapacity , maxCapacity , targetIterMs ) ;
+
+    // A bulk request is the largest message we accept
+    static union {
+        msgBuf      one ;
+        bulkMsgBuf  bulk ;
+    } rcvMsg ;
 
     int forever = 1;
     while ( forever )
     {
-        addrLen = sizeof(clntSkt);
         printf( "\nFACTORY server waiting for Order Requests\n" ) ; 
 
-        // Wait to receive request message
-        msgBuf rcvMsg;
-        if (recvfrom(sd, (void *) &rcvMsg, sizeof(rcvMsg), 0, (SA *) &clntSkt, &addrLen) < 0) {
-            err_sys("Error receiving the order request from the client");
-        }
-        printf("\n\nFACTORY server received: " ) ;
-        printMsg( & rcvMsg );  puts("");
+        // Wait to receive a request message, then take the ones already
+        // queued behind it too, so that their orders share a journal sync
+        int  flags = 0 ;
+        while ( numPending < RECV_BATCH )
+        {
+            addrLen = sizeof(clntSkt);
+            ssize_t len = recvfrom(sd, (void *) &rcvMsg, sizeof(rcvMsg), flags, (SA *) &clntSkt, &addrLen) ;
+            if (len < 0) {
+                if ( flags != 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+                    break ;     // nothing more waiting
+                err_sys("Error receiving the order request from the client");
+            }
+            flags = MSG_DONTWAIT ;
 
-        char clientIP[IPSTRLEN];
-        inet_ntop(AF_INET, (void *) &clntSkt.sin_addr.s_addr, clientIP, IPSTRLEN);
-        printf("        From IP %s Port %d", clientIP, ntohs(clntSkt.sin_port));
+            // An older client's message has no orderID
+            if ( len >= MSG_MIN_LEN && len < sizeof( msgBuf ) )
+                rcvMsg.one.orderID = 0 ;
 
-        // Set order size and remainsToMake
-        orderSize = ntohl(rcvMsg.orderSize);
+            printf("\n\nFACTORY server received: " ) ;
+            printMsg( & rcvMsg.one );  puts("");
 
-        pthread_mutex_lock(&remains_mutex);
-        remainsToMake += orderSize;
-        pthread_mutex_unlock(&remains_mutex);
+            char clientIP[IPSTRLEN];
+            inet_ntop(AF_INET, (void *) &clntSkt.sin_addr.s_addr, clientIP, IPSTRLEN);
+            printf("        From IP %s Port %d", clientIP, ntohs(clntSkt.sin_port));
 
-        // Create the confirmation message
-        msgBuf cnfMsg;
-        cnfMsg.numFac = htonl(1);
-        cnfMsg.purpose = htonl(ORDR_CONFIRM);
+            // Anything but a single request goes after the confirmations held so far
+            if ( ntohl( rcvMsg.one.purpose ) != REQUEST_MSG )
+                flushReplies() ;
 
-        // Send the confirmation message
-        if (sendto(sd, (void *)&cnfMsg, sizeof(cnfMsg), 0, (SA * ) &clntSkt, sizeof(clntSkt)) < 0) {
-            err_sys("Error sending the order confirmation message");
+            switch ( ntohl( rcvMsg.one.purpose ) )
+            {
+              case REQUEST_MSG:
+                if ( len < MSG_MIN_LEN )
+                    sendProtocolErr( 0 ) ;
+                else
+                    handleRequest( &rcvMsg.one ) ;
+                break ;
+
+              case BULK_REQUEST:
+                if ( len < BULK_MSG_LEN( 0 ) || ntohl( rcvMsg.bulk.numOrders ) > MAXBULK
+                     || len < BULK_MSG_LEN( ntohl( rcvMsg.bulk.numOrders ) ) )
+                    sendProtocolErr( 0 ) ;
+                else
+                    handleBulkRequest( &rcvMsg.bulk ) ;
+                break ;
+
+              case CANCEL_MSG:
+                if ( len < MSG_MIN_LEN )
+                    sendProtocolErr( 0 ) ;
+                else
+                    handleCancel( &rcvMsg.one ) ;
+                break ;
+
+              case CAPACITY_QUERY:
+                handleCapacityQuery() ;
+                break ;
+
+              default:
+                sendProtocolErr( 0 ) ;
+                break ;
+            }
         }
-        printf("\n\nFACTORY sent this Order Confirmation to the client " );
-        printMsg(  & cnfMsg );  puts("");
-        
-        subFactory( 1 , 50 , 350 ) ;  // Single factory, ID=1 , capacity=50, duration=350 ms
+        flushReplies() ;
     }
     return 0 ;
 }
 
+//------------------------------------------------------------
+//  Adaptive mode: pick this line's next capacity.
+//  With little backlog, small batches keep report latency low;
+//  as backlog builds up, batches grow toward the line's fair
+//  share of it to amortize the per-iteration setup time. The
+//  observed time of the last iteration caps the batch so that
+//  an iteration stays within targetIterMs.
+//  Called with remains_mutex held.
+//------------------------------------------------------------
+int adaptCapacity( int capacity , int lastParts , int lastIterMs )
+{
+    long share = ( backlog + numLines - 1 ) / numLines ;
+    long want  = share < minCapacity ? minCapacity : share > maxCapacity ? maxCapacity : share ;
+
+    // Move halfway toward the target to avoid oscillating with bursty arrivals
+    long next = ( capacity + want + 1 ) / 2 ;
+
+    // Predict the time for 'next' parts from the last iteration's pace
+    if ( lastParts > 0 && lastIterMs > 0 )
+    {
+        double msPerPart = (double) lastIterMs / lastParts ;
+        long   fits      = (long) ( targetIterMs / msPerPart ) ;
+        if ( next > fits )
+            next = fits ;
+    }
+
+    if ( next < minCapacity )  next = minCapacity ;
+    if ( next > maxCapacity )  next = maxCapacity ;
+    return (int) next ;
+}
+
+//------------------------------------------------------------
+//  A factory line. Repeatedly claims a batch from the next order
+//  of the client whose turn it is, makes it, and reports it to
+//  that client. Clients share the lines by weight, and within a
+//  client orders with parts left go back to the tail of its queue,
+//  so they are served round-robin. A client over its parts or
+//  report rate is skipped until its tokens refill, and a batch
+//  never exceeds the parts its tokens allow.
+//  Cancelled orders are dropped at the next claim, and a batch
+//  being made for one is abandoned as soon as the line is woken.
+//------------------------------------------------------------
 void subFactory( int factoryID , int myCapacity , int myDuration )
 {
-    char    strBuff[ MAXSTR ] ;   // snprint buffer
-    int     partsImade = 0 , myIterations = 0 ;
     msgBuf  msg;
+    struct sockaddr_in  to ;
+    lineState_t *me = &lines[ factoryID - 1 ] ;
+    int     lastParts = 0 , lastIterMs = 0 ;
 
-    
+    if ( adaptive )
+        myCapacity = minCapacity ;
+
+    pthread_mutex_lock(&remains_mutex);
     while (1)
     {
-        // See if there are still any parts to manufacture
-        pthread_mutex_lock(&remains_mutex);
-        if ( remainsToMake <= 0 ) {
-            pthread_mutex_unlock(&remains_mutex);
-            break ;   // Not anymore, exit the loop
+        // Wait for an order with parts still to manufacture, and tokens to make them
+        sessHandle_t     h ;
+        int              allowed ;
+        long long        waitUs ;
+        struct timespec  until , began , ended ;
+        while ( ( h = clientPick( &clients , &sessions , myCapacity , &allowed , &waitUs ) ) == SESS_NIL )
+        {
+            if ( waitUs < 0 )
+                lineWait( &work_cond , NULL ) ;
+            else {
+                deadlineIn( &until , waitUs ) ;
+                lineWait( &work_cond , &until ) ;
+            }
         }
 
-        // Calculate how many parts to make and sleep for the duration
-        int partsToMake = minimum(remainsToMake, myCapacity);
-        remainsToMake -= partsToMake;
-        pthread_mutex_unlock(&remains_mutex);
+        session_t *s = sessGet( &sessions , h ) ;
+        if ( s->flags & SESS_CANCELLED ) {
+            if ( s->busyLines == 0 )
+                releaseOrder( h ) ;
+            continue ;
+        }
 
-        Usleep(myDuration * 1000);
-        partsImade += partsToMake;
-        myIterations++;
+        // Calculate how many parts to make
+        if ( adaptive )
+            myCapacity = adaptCapacity( myCapacity , lastParts , lastIterMs ) ;
+        int partsToMake = minimum((int) minimumU(s->remains, myCapacity), allowed);
+        if ( adaptive )
+            myDuration = LINE_SETUP_MS + LINE_MS_PER_PART * partsToMake ;
+        s->remains -= partsToMake;
+        backlog    -= partsToMake;
+        s->busyLines++ ;
+        clientCharge( &clients , s->client , partsToMake ) ;
+        if ( s->remains > 0 )
+            clientEnqueue( &clients , &sessions , h ) ;
+        sessAddr( s , &to ) ;
 
         printf("Factory #%3d: Going to make %5d parts in %4d mSec\n", factoryID, partsToMake, myDuration);
 
+        // Sleep for the duration, unless the order is cancelled meanwhile
+        clock_gettime( CLOCK_MONOTONIC , &began ) ;
+        deadlineIn( &until , myDuration * 1000LL ) ;
+        me->order = h ;
+        while ( ! ( s->flags & SESS_CANCELLED )
+                && lineWait( &me->wake , &until ) != ETIMEDOUT )
+            ;
+        me->order = SESS_NIL ;
+
+        // What this iteration really took, including any scheduling delay
+        clock_gettime( CLOCK_MONOTONIC , &ended ) ;
+        lastIterMs = ( ended.tv_sec - began.tv_sec ) * 1000
+                   + ( ended.tv_nsec - began.tv_nsec ) / 1000000 ;
+        lastParts  = partsToMake ;
+
+        s = sessGet( &sessions , h ) ;      // still valid, we hold a busy line on it
+        s->busyLines-- ;
+
+        if ( s->flags & SESS_CANCELLED ) {
+            printf("Factory #%3d: Dropped %5d parts of cancelled order #%u\n", factoryID, partsToMake, s->orderID);
+            lastParts = 0 ;     // a cut-short iteration says nothing about the pace
+            if ( s->busyLines == 0 && ! ( s->flags & SESS_QUEUED ) )
+                releaseOrder( h ) ;
+            continue ;
+        }
+
+        s->made += partsToMake ;
+        s->iters++ ;
+
+        // Log the finished batch; it is synced with the next group commit
+        journalAppend( &jrnl, JRNL_CLAIM, s->orderID, s->clientIP, s->clientPort,
+                       s->clientOrder, partsToMake ) ;
+        trimJournal() ;     // long orders add claims without ever releasing
+
         // Send a Production Message to Supervisor
         msg.facID = htonl(factoryID);
         msg.capacity = htonl(myCapacity);
         msg.partsMade = htonl(partsToMake);
-        msg.duration = htonl(myDuration);
+        msg.duration = htonl(adaptive ? lastIterMs : myDuration);
+        msg.orderID = htonl(s->clientOrder);
         msg.purpose = htonl(PRODUCTION_MSG);
 
-        if (sendto(sd, (void *) &msg, sizeof(msg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
+        if (sendto(sd, (void *) &msg, sizeof(msg), 0, (SA *) &to, sizeof(to)) < 0) {
             err_sys("Error sending production message");
         }
-    }
-
-    // Send a Completion Message to Supervisor
-    msgBuf cmpMsg;
-    cmpMsg.facID = htonl(1);
-    cmpMsg.purpose = htonl(COMPLETION_MSG);
 
-    if (sendto(sd, (void *) &cmpMsg, sizeof(cmpMsg), 0, (SA *) &clntSkt, sizeof(clntSkt)) < 0) {
-        err_sys("Error sending completion message");
+        if ( s->remains == 0 && s->busyLines == 0 )
+            finishOrder( h ) ;
     }
-
-    snprintf( strBuff , MAXSTR , ">>> Factory # %-3d: Terminating after making total of %-5d parts in %-4d iterations\n" 
-          , factoryID, partsImade, myIterations);
-    factLog( strBuff ) ;
 }
 // lab computers
 // L24820 L24821
@@ -0,0 +1,457 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : impair.c
+//
+// A UDP relay that sits between procurement and the factory server
+// and impairs the traffic: loss, delay, jitter, duplication and
+// reordering, all driven by a seeded RNG so that runs are repeatable.
+//
+//   procurement  --->  impair <listenPort>  --->  factory <serverIP> <serverPort>
+//
+// Each client gets its own upstream socket, so the factory still sees
+// one address per client and its replies can be routed back. A client
+// quiet for PEER_IDLE_SECS gives its socket up, and when every slot is
+// taken the least recently active client makes room for a new one.
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <stdint.h>
+
+#include "wrappers.h"
+#include "message.h"
+
+#define MAXPEERS        64          /* distinct clients relayed at once */
+#define PEER_IDLE_SECS  30          /* a client this quiet is forgotten */
+#define MAXPENDING      1024        /* datagrams waiting for their release time */
+#define MAXDGRAM        sizeof( bulkMsgBuf )
+#define REORDER_GAP_MS  10          /* a reordered datagram is held back this much more */
+#define REPORT_SECS     5           /* print the counters this often while busy */
+#define IPSTRLEN        50
+
+typedef struct sockaddr SA ;
+
+enum { UP = 0 , DOWN = 1 } ;        /* UP = procurement -> factory */
+
+typedef struct {
+    unsigned long   received , dropped , duplicated , reordered ,
+                    delivered , overflow , bytes ;
+} counters_t ;
+
+typedef struct {
+    long long       releaseUs ;     /* when to send it */
+    unsigned long   seq ;           /* keeps equal release times in arrival order */
+    int             dir , peer ;
+    size_t          len ;
+    char            data[ MAXDGRAM ] ;
+} pending_t ;
+
+typedef struct {
+    struct sockaddr_in  client ;    /* the procurement process */
+    int                 upSd ;      /* our socket toward the factory for it , -1 = free slot */
+    long long           lastUs ;    /* last datagram either way */
+    int                 queued ;    /* pending datagrams that still refer to this slot */
+} peer_t ;
+
+// Impairment settings
+double      lossPct = 0 , dupPct = 0 , reorderPct = 0 ;
+int         delayMs = 0 , jitterMs = 0 ;
+uint64_t    rngState = 1 ;
+
+int         cliSd ;                 // clients send to this socket
+struct sockaddr_in  srvrSkt ;       // the factory server
+
+peer_t      peers[ MAXPEERS ] ;
+unsigned long peersExpired = 0 ,    // idle clients forgotten
+              peersFull = 0 ;       // datagrams from new clients with no slot for them
+
+pending_t   pool[ MAXPENDING ] ;    // all pending datagrams live here
+int         heap[ MAXPENDING ] ,    // min-heap of pool slots by release time
+            freeSlots[ MAXPENDING ] ;
+int         heapLen = 0 , numFree = 0 ;
+unsigned long nextSeq = 0 ;
+
+counters_t  stats[ 2 ] ;
+volatile sig_atomic_t  done = 0 ;
+
+//------------------------------------------------------------
+//  xorshift64* : tiny and identical on every platform
+//------------------------------------------------------------
+uint64_t rng( void )
+{
+    rngState ^= rngState >> 12 ;
+    rngState ^= rngState << 25 ;
+    rngState ^= rngState >> 27 ;
+    return rngState * 0x2545F4914F6CDD1DULL ;
+}
+
+double rngPct( void )       /* uniform in [0,100) */
+{
+    return ( rng() >> 11 ) * ( 100.0 / 9007199254740992.0 ) ;
+}
+
+long long nowUs( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 ;
+}
+
+void stopRelay( int sig )
+{
+    done = 1 ;
+}
+
+//------------------------------------------------------------
+//  Print the counters of both directions
+//------------------------------------------------------------
+void printCounters( void )
+{
+    static const char *name[ 2 ] = { "procurement->factory" , "factory->procurement" } ;
+
+    for ( int d = UP ; d <= DOWN ; d++ )
+        printf( "IMPAIR %-20s: received %6lu , dropped %6lu , duplicated %6lu , reordered %6lu ,"
+                " delivered %6lu ( %lu bytes ) , queue overflow %lu\n"
+              , name[ d ] , stats[ d ].received , stats[ d ].dropped , stats[ d ].duplicated
+              , stats[ d ].reordered , stats[ d ].delivered , stats[ d ].bytes , stats[ d ].overflow ) ;
+    printf( "IMPAIR clients              : %lu forgotten , %lu datagrams dropped with the client table full\n"
+          , peersExpired , peersFull ) ;
+    fflush( stdout ) ;
+}
+
+/*--------------------------------------------------------------------
+   Min-heap of pending datagrams ordered by ( releaseUs , seq )
+----------------------------------------------------------------------*/
+int earlier( int a , int b )
+{
+    return pool[ a ].releaseUs < pool[ b ].releaseUs
+        || ( pool[ a ].releaseUs == pool[ b ].releaseUs && pool[ a ].seq < pool[ b ].seq ) ;
+}
+
+void heapPush( int slot )
+{
+    int i = heapLen++ ;
+    while ( i > 0 && earlier( slot , heap[ ( i - 1 ) / 2 ] ) ) {
+        heap[ i ] = heap[ ( i - 1 ) / 2 ] ;
+        i = ( i - 1 ) / 2 ;
+    }
+    heap[ i ] = slot ;
+}
+
+int heapPop( void )
+{
+    int top = heap[ 0 ] , last = heap[ --heapLen ] , i = 0 ;
+
+    for ( ;; ) {
+        int c = 2 * i + 1 ;
+        if ( c >= heapLen )
+            break ;
+        if ( c + 1 < heapLen && earlier( heap[ c + 1 ] , heap[ c ] ) )
+            c++ ;
+        if ( ! earlier( heap[ c ] , last ) )
+            break ;
+        heap[ i ] = heap[ c ] ;
+        i = c ;
+    }
+    if ( heapLen > 0 )
+        heap[ i ] = last ;
+    return top ;
+}
+
+//------------------------------------------------------------
+//  Forget a client and close its upstream socket
+//------------------------------------------------------------
+void dropPeer( int i , const char *why )
+{
+    char ipStr[ IPSTRLEN ] ;
+    inet_ntop( AF_INET , (void *) &peers[ i ].client.sin_addr.s_addr , ipStr , IPSTRLEN ) ;
+    printf( "IMPAIR: forgot client IP %s Port %d , %s\n" , ipStr , ntohs( peers[ i ].client.sin_port ) , why ) ;
+
+    close( peers[ i ].upSd ) ;
+    peers[ i ].upSd = -1 ;
+    peersExpired++ ;
+}
+
+//------------------------------------------------------------
+//  Forget the clients that have gone quiet
+//------------------------------------------------------------
+void expirePeers( void )
+{
+    long long now = nowUs() ;
+
+    for ( int i = 0 ; i < MAXPEERS ; i++ )
+        if ( peers[ i ].upSd >= 0 && peers[ i ].queued == 0
+             && now - peers[ i ].lastUs >= PEER_IDLE_SECS * 1000000LL )
+            dropPeer( i , "idle" ) ;
+}
+
+//------------------------------------------------------------
+//  Find the peer for a client address, adding it if new.
+//  Returns -1 when every slot has datagrams still queued.
+//------------------------------------------------------------
+int findPeer( struct sockaddr_in *from )
+{
+    int slot = -1 , lru = -1 ;
+
+    for ( int i = 0 ; i < MAXPEERS ; i++ )
+    {
+        peer_t *p = &peers[ i ] ;
+        if ( p->upSd < 0 ) {
+            if ( slot < 0 )
+                slot = i ;
+            continue ;
+        }
+        if ( p->client.sin_addr.s_addr == from->sin_addr.s_addr
+             && p->client.sin_port == from->sin_port )
+            return i ;
+        if ( p->queued == 0 && ( lru < 0 || p->lastUs < peers[ lru ].lastUs ) )
+            lru = i ;
+    }
+
+    if ( slot < 0 ) {
+        if ( lru < 0 ) {
+            peersFull++ ;
+            return -1 ;
+        }
+        dropPeer( lru , "to make room for a new one" ) ;
+        slot = lru ;
+    }
+
+    peer_t *p = &peers[ slot ] ;
+    p->client = *from ;
+    p->queued = 0 ;
+    p->upSd   = socket( AF_INET , SOCK_DGRAM , 0 ) ;
+    if ( p->upSd < 0 )
+        err_sys( "Couldn't create an upstream UDP socket" ) ;
+
+    char ipStr[ IPSTRLEN ] ;
+    inet_ntop( AF_INET , (void *) &from->sin_addr.s_addr , ipStr , IPSTRLEN ) ;
+    printf( "IMPAIR: new client IP %s Port %d\n" , ipStr , ntohs( from->sin_port ) ) ;
+    return slot ;
+}
+
+//------------------------------------------------------------
+//  Apply the impairments to one received datagram
+//------------------------------------------------------------
+void impair( int dir , int peer , const char *data , size_t len )
+{
+    counters_t *c = &stats[ dir ] ;
+
+    c->received++ ;
+    peers[ peer ].lastUs = nowUs() ;
+    if ( rngPct() < lossPct ) {
+        c->dropped++ ;
+        return ;
+    }
+
+    int copies = 1 ;
+    if ( rngPct() < dupPct ) {
+        c->duplicated++ ;
+        copies = 2 ;
+    }
+
+    for ( int k = 0 ; k < copies ; k++ )
+    {
+        long long d = delayMs * 1000LL ;
+        if ( jitterMs > 0 )
+            d += (long long) ( rng() % ( 2 * jitterMs * 1000ULL + 1 ) ) - jitterMs * 1000LL ;
+        if ( rngPct() < reorderPct ) {
+            c->reordered++ ;
+            d += ( delayMs + jitterMs + REORDER_GAP_MS ) * 1000LL ;   // let later ones overtake
+        }
+        if ( d < 0 )
+            d = 0 ;
+
+        if ( numFree == 0 ) {
+            c->overflow++ ;
+            continue ;
+        }
+        int slot = freeSlots[ --numFree ] ;
+        pending_t *p = &pool[ slot ] ;
+        p->releaseUs = nowUs() + d ;
+        p->seq       = nextSeq++ ;
+        p->dir       = dir ;
+        p->peer      = peer ;
+        p->len       = len ;
+        memcpy( p->data , data , len ) ;
+        heapPush( slot ) ;
+        peers[ peer ].queued++ ;
+    }
+}
+
+//------------------------------------------------------------
+//  Send every datagram whose release time has come
+//------------------------------------------------------------
+void releaseDue( void )
+{
+    long long now = nowUs() ;
+
+    while ( heapLen > 0 && pool[ heap[ 0 ] ].releaseUs <= now )
+    {
+        int        slot = heapPop() ;
+        pending_t *p    = &pool[ slot ] ;
+        peer_t    *peer = &peers[ p->peer ] ;
+        ssize_t    n ;
+
+        if ( p->dir == UP )
+            n = sendto( peer->upSd , p->data , p->len , 0 , (SA *) &srvrSkt , sizeof( srvrSkt ) ) ;
+        else
+            n = sendto( cliSd , p->data , p->len , 0 , (SA *) &peer->client , sizeof( peer->client ) ) ;
+        if ( n < 0 )
+            err_sys( "Error relaying a datagram" ) ;
+
+        stats[ p->dir ].delivered++ ;
+        stats[ p->dir ].bytes += p->len ;
+        peer->queued-- ;
+        freeSlots[ numFree++ ] = slot ;
+    }
+}
+
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    int       opt ;
+    unsigned long long seed = 1 ;
+    static char buf[ MAXDGRAM ] ;
+
+    while ( ( opt = getopt( argc , argv , "l:d:j:u:r:s:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+          case 'l':  lossPct    = atof( optarg ) ;            break ;   // % of datagrams lost
+          case 'd':  delayMs    = atoi( optarg ) ;            break ;   // one-way delay
+          case 'j':  jitterMs   = atoi( optarg ) ;            break ;   // +/- around the delay
+          case 'u':  dupPct     = atof( optarg ) ;            break ;   // % duplicated
+          case 'r':  reorderPct = atof( optarg ) ;            break ;   // % held back to reorder
+          case 's':  seed       = strtoull( optarg , NULL , 10 ) ; break ;
+
+          default:
+            argc = 0 ;      // print the usage below
+            break ;
+        }
+    }
+
+    if ( argc - optind != 3 )
+    {
+        printf( "IMPAIR Usage: %s [-l loss%%] [-d delayMs] [-j jitterMs] [-u dup%%] [-r reorder%%] [-s seed]"
+                " <listenPort> <FactoryServerIP> <port>\n" , argv[0] ) ;
+        exit( 1 ) ;
+    }
+
+    unsigned short  listenPort = (unsigned short) atoi( argv[optind] ) ;
+    char           *serverIP   = argv[optind+1] ;
+    unsigned short  port       = (unsigned short) atoi( argv[optind+2] ) ;
+
+    rngState = seed ? seed : 1 ;        // xorshift must not start at zero
+    for ( int i = 0 ; i < MAXPENDING ; i++ )
+        freeSlots[ numFree++ ] = MAXPENDING - 1 - i ;
+    for ( int i = 0 ; i < MAXPEERS ; i++ )
+        peers[ i ].upSd = -1 ;
+
+    sigactionWrapper( SIGINT , stopRelay ) ;
+    sigactionWrapper( SIGTERM , stopRelay ) ;
+
+    // The factory server we relay to
+    memset( (void *) &srvrSkt, 0, sizeof(srvrSkt));
+    srvrSkt.sin_family = AF_INET;
+    srvrSkt.sin_port = htons(port);
+    if (inet_pton(AF_INET, serverIP, (void *) &srvrSkt.sin_addr.s_addr) != 1) {
+        err_quit("Invalid IP Address\n");
+    }
+
+    // The socket procurement clients talk to
+    struct sockaddr_in  me ;
+    cliSd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (cliSd < 0) {
+        err_sys("Couldn't create a UDP socket");
+    }
+    memset( (void *) &me, 0, sizeof(me));
+    me.sin_family = AF_INET;
+    me.sin_port = htons(listenPort);
+    me.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(cliSd, (SA *) &me, sizeof(me)) < 0) {
+        err_sys("Couldn't bind the socket to the relay port");
+    }
+
+    printf( "IMPAIR: relaying port %d to %s : %d with loss=%.1f%% delay=%dms jitter=%dms dup=%.1f%% reorder=%.1f%% seed=%llu\n"
+          , listenPort , serverIP , port , lossPct , delayMs , jitterMs , dupPct , reorderPct , seed ) ;
+    fflush( stdout ) ;
+
+    long long lastReport = nowUs() ;
+    unsigned long lastTotal = 0 ;
+
+    while ( ! done )
+    {
+        expirePeers() ;
+
+        // Free slots have fd -1 , which poll() skips
+        struct pollfd fds[ MAXPEERS + 1 ] ;
+        fds[ 0 ].fd = cliSd ;
+        fds[ 0 ].events = POLLIN ;
+        for ( int i = 0 ; i < MAXPEERS ; i++ ) {
+            fds[ i+1 ].fd = peers[ i ].upSd ;
+            fds[ i+1 ].events = POLLIN ;
+        }
+
+        int timeoutMs = REPORT_SECS * 1000 ;
+        if ( heapLen > 0 ) {
+            long long wait = pool[ heap[ 0 ] ].releaseUs - nowUs() ;
+            timeoutMs = wait <= 0 ? 0 : (int) ( ( wait + 999 ) / 1000 ) ;
+        }
+
+        if ( poll( fds , MAXPEERS + 1 , timeoutMs ) < 0 ) {
+            if ( errno == EINTR )
+                continue ;
+            err_sys( "poll failed" ) ;
+        }
+
+        // From a client, toward the factory
+        if ( fds[ 0 ].revents & POLLIN )
+        {
+            struct sockaddr_in  from ;
+            socklen_t  addrLen = sizeof( from ) ;
+            ssize_t    n = recvfrom( cliSd , buf , sizeof( buf ) , 0 , (SA *) &from , &addrLen ) ;
+            if ( n >= 0 ) {
+                int p = findPeer( &from ) ;
+                if ( p >= 0 )
+                    impair( UP , p , buf , n ) ;
+            }
+        }
+
+        // From the factory, back to a client. A slot findPeer() just
+        // handed to a new client may show what its old socket had.
+        for ( int i = 0 ; i < MAXPEERS ; i++ )
+        {
+            if ( ! ( fds[ i+1 ].revents & POLLIN ) || peers[ i ].upSd < 0 )
+                continue ;
+            ssize_t n = recv( peers[ i ].upSd , buf , sizeof( buf ) , MSG_DONTWAIT ) ;
+            if ( n >= 0 )
+                impair( DOWN , i , buf , n ) ;
+        }
+
+        releaseDue() ;
+
+        unsigned long total = stats[ UP ].received + stats[ DOWN ].received ;
+        if ( nowUs() - lastReport >= REPORT_SECS * 1000000LL && total != lastTotal ) {
+            printCounters() ;
+            lastTotal  = total ;
+            lastReport = nowUs() ;
+        }
+    }
+
+    printf( "\nIMPAIR: final counters\n" ) ;
+    printCounters() ;
+    return 0 ;
+}
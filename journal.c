@@ -0,0 +1,307 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : journal.c
+//
+// Append-only order journal kept in a memory-mapped file.
+// Records are fixed size, so replay is a linear scan of the mapping.
+// Durability uses group commit: msync() runs once per batch of records
+// instead of once per record.
+// Appends, resets and checkpoints come from the caller under its own
+// lock. journalCommit() may run alongside them, so the msync itself
+// happens outside the journal lock; the mapping is only replaced once
+// no msync is running.
+//---------------------------------------------------------------------
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <libgen.h>
+#include <limits.h>
+#include <time.h>
+
+#include "wrappers.h"
+#include "journal.h"
+
+static long long nowUsec( void )
+{
+    struct timespec ts ;
+    clock_gettime( CLOCK_MONOTONIC , &ts ) ;
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 ;
+}
+
+static uint32_t recCheck( const jrnlRec *r )
+{
+    uint32_t h = JRNL_MAGIC ;
+    h = ( h ^ r->type       ) * 16777619 ;
+    h = ( h ^ r->orderID    ) * 16777619 ;
+    h = ( h ^ r->clientIP   ) * 16777619 ;
+    h = ( h ^ r->clientOrder) * 16777619 ;
+    h = ( h ^ r->amount     ) * 16777619 ;
+    h = ( h ^ r->clientPort ) * 16777619 ;
+    return h ;
+}
+
+//------------------
+// Wait until no msync is using the mapping. Called with j->lock held.
+
+static void waitIdle( journal_t *j )
+{
+    while ( j->syncing > 0 )
+        pthread_cond_wait( &j->idle , &j->lock ) ;
+}
+
+//------------------
+// Sync everything appended so far. Called with j->lock held and no
+// msync running, so the mapping cannot change underneath.
+
+static void syncAll( journal_t *j )
+{
+    size_t  page  = (size_t) sysconf( _SC_PAGESIZE ) ;
+    size_t  start = j->synced - j->synced % page ;
+
+    if ( j->synced < j->tail && msync( j->base + start , j->tail - start , MS_SYNC ) < 0 )
+        err_sys( "journal: msync failed" ) ;
+    j->synced  = j->tail ;
+    j->pending = 0 ;
+}
+
+/*--------------------------------------------------------------------
+   Resize the file to 'len' bytes and map all of it
+----------------------------------------------------------------------*/
+static void remap( journal_t *j , size_t len )
+{
+    if ( j->base != NULL && munmap( j->base , j->mapLen ) < 0 )
+        err_sys( "journal: munmap failed" ) ;
+
+    if ( ftruncate( j->fd , len ) < 0 )
+        err_sys( "journal: ftruncate failed" ) ;
+    if ( fsync( j->fd ) < 0 )       // make the new file size durable
+        err_sys( "journal: fsync failed" ) ;
+
+    j->base = mmap( NULL , len , PROT_READ | PROT_WRITE , MAP_SHARED , j->fd , 0 ) ;
+    if ( j->base == MAP_FAILED )
+        err_sys( "journal: mmap failed" ) ;
+    j->mapLen = len ;
+}
+
+//------------------
+// Open a journal file for writing and hold its lock until it is closed
+
+static int openLocked( const char *path , int flags )
+{
+    int fd = open( path , O_RDWR | O_CREAT | flags , 0644 ) ;
+    if ( fd < 0 )
+        err_sys( "journal: cannot open journal file" ) ;
+    if ( flock( fd , LOCK_EX | LOCK_NB ) < 0 )
+    {
+        if ( errno == EWOULDBLOCK )
+            err_quit( "journal: the journal file is in use by another server\n" ) ;
+        err_sys( "journal: flock failed" ) ;
+    }
+    return fd ;
+}
+
+/*--------------------------------------------------------------------
+   Open (or create) the journal file and map it. The file stays
+   locked while it is open, so a second server can neither replay
+   orders that are still in flight nor append to the same log.
+----------------------------------------------------------------------*/
+void journalOpen( journal_t *j , const char *path )
+{
+    struct stat st ;
+
+    memset( j , 0 , sizeof( *j ) ) ;
+    pthread_mutex_init( &j->lock , NULL ) ;
+    pthread_cond_init( &j->idle , NULL ) ;
+    if ( ( j->path = strdup( path ) ) == NULL )
+        err_quit( "journal: out of memory\n" ) ;
+    j->fd = openLocked( path , 0 ) ;
+    if ( fstat( j->fd , &st ) < 0 )
+        err_sys( "journal: fstat failed" ) ;
+
+    size_t len = st.st_size ;
+    len -= len % JRNL_CHUNK ;
+    if ( len < (size_t) st.st_size || len == 0 )
+        len += JRNL_CHUNK ;
+    remap( j , len ) ;
+}
+
+/*--------------------------------------------------------------------
+   Feed every intact record to 'fn' in order, and position the tail
+   right after the last one. Returns the number of records replayed.
+----------------------------------------------------------------------*/
+size_t journalReplay( journal_t *j , jrnlReplayFunc *fn , void *arg )
+{
+    size_t  n = 0 , off ;
+
+    for ( off = 0 ; off + sizeof( jrnlRec ) <= j->mapLen ; off += sizeof( jrnlRec ) )
+    {
+        const jrnlRec *r = (const jrnlRec *) ( j->base + off ) ;
+        if ( r->type == JRNL_END || r->check != recCheck( r ) )
+            break ;     // end of the log, or a record torn by the crash
+        fn( r , arg ) ;
+        n++ ;
+    }
+
+    // Wipe a torn record so that a later, shorter append can't revive it
+    if ( off + sizeof( jrnlRec ) <= j->mapLen )
+        memset( j->base + off , 0 , sizeof( jrnlRec ) ) ;
+
+    j->tail = j->synced = off ;
+    return n ;
+}
+
+/*--------------------------------------------------------------------
+   Append one record. It is not synced here: it becomes durable at
+   the next journalCommit() that gets to it, so a whole batch of
+   records can share one sync.
+----------------------------------------------------------------------*/
+void journalAppend( journal_t *j , jrnlType_t type , unsigned orderID ,
+                    uint32_t clientIP , uint16_t clientPort , unsigned clientOrder ,
+                    unsigned amount )
+{
+    jrnlRec  r ;
+
+    pthread_mutex_lock( &j->lock ) ;
+    if ( j->tail + sizeof( jrnlRec ) > j->mapLen ) {
+        waitIdle( j ) ;
+        remap( j , j->mapLen * 2 ) ;
+    }
+
+    memset( &r , 0 , sizeof( r ) ) ;
+    r.type       = type ;
+    r.orderID    = orderID ;
+    r.clientIP   = clientIP ;
+    r.clientPort = clientPort ;
+    r.clientOrder= clientOrder ;
+    r.amount     = amount ;
+    r.check      = recCheck( &r ) ;
+    memcpy( j->base + j->tail , &r , sizeof( r ) ) ;
+    j->tail += sizeof( r ) ;
+
+    if ( j->pending++ == 0 )
+        j->firstPendingUs = nowUsec() ;
+    pthread_mutex_unlock( &j->lock ) ;
+}
+
+/*--------------------------------------------------------------------
+   Sync appended records to disk. With 'force', everything appended
+   before the call is durable when it returns. Without it, only sync
+   once the group is full or its oldest record has waited long
+   enough. Records appended meanwhile join the next group.
+----------------------------------------------------------------------*/
+void journalCommit( journal_t *j , int force )
+{
+    pthread_mutex_lock( &j->lock ) ;
+    if ( j->synced >= j->tail
+         || ( ! force && ( j->pending == 0 || ( j->pending < JRNL_GROUP_RECS
+                           && nowUsec() - j->firstPendingUs < JRNL_GROUP_USEC ) ) ) )
+    {
+        pthread_mutex_unlock( &j->lock ) ;
+        return ;
+    }
+
+    size_t  page  = (size_t) sysconf( _SC_PAGESIZE ) ;
+    size_t  start = j->synced - j->synced % page ,
+            end   = j->tail ;
+    j->pending = 0 ;
+    j->syncing++ ;
+    pthread_mutex_unlock( &j->lock ) ;
+
+    if ( msync( j->base + start , end - start , MS_SYNC ) < 0 )
+        err_sys( "journal: msync failed" ) ;
+
+    pthread_mutex_lock( &j->lock ) ;
+    if ( end > j->synced )
+        j->synced = end ;
+    if ( --j->syncing == 0 )
+        pthread_cond_broadcast( &j->idle ) ;
+    pthread_mutex_unlock( &j->lock ) ;
+}
+
+//------------------
+// uSec until the pending group is due for a sync, -1 if nothing is pending.
+// Nothing syncs by itself, so a caller that is about to sleep should wake
+// up by then and call journalCommit().
+
+long long journalDueUs( journal_t *j )
+{
+    long long left = -1 ;
+
+    pthread_mutex_lock( &j->lock ) ;
+    if ( j->pending > 0 ) {
+        left = j->firstPendingUs + JRNL_GROUP_USEC - nowUsec() ;
+        if ( left < 0 || j->pending >= JRNL_GROUP_RECS )
+            left = 0 ;
+    }
+    pthread_mutex_unlock( &j->lock ) ;
+    return left ;
+}
+
+/*--------------------------------------------------------------------
+   Discard every record. Only safe when no order is in flight.
+----------------------------------------------------------------------*/
+void journalReset( journal_t *j )
+{
+    pthread_mutex_lock( &j->lock ) ;
+    waitIdle( j ) ;
+    syncAll( j ) ;
+    munmap( j->base , j->mapLen ) ;
+    j->base = NULL ;
+    if ( ftruncate( j->fd , 0 ) < 0 )
+        err_sys( "journal: ftruncate failed" ) ;
+    remap( j , JRNL_CHUNK ) ;
+    j->tail = j->synced = 0 ;
+    pthread_mutex_unlock( &j->lock ) ;
+}
+
+/*--------------------------------------------------------------------
+   Replace the log with a compact one while orders are in flight.
+   'fn' appends records that sum up every live order. They go to a
+   new file that is synced and then renamed over the old one, so a
+   crash at any point leaves one complete journal behind.
+----------------------------------------------------------------------*/
+void journalCheckpoint( journal_t *j , jrnlCheckpointFunc *fn , void *arg )
+{
+    char  tmp[ PATH_MAX ] , dir[ PATH_MAX ] ;
+    int   oldFd = j->fd , dirFd ;
+
+    pthread_mutex_lock( &j->lock ) ;
+    waitIdle( j ) ;
+    syncAll( j ) ;
+    munmap( j->base , j->mapLen ) ;
+
+    snprintf( tmp , sizeof( tmp ) , "%s.tmp" , j->path ) ;
+    j->fd   = openLocked( tmp , O_TRUNC ) ;     // may be left over from a crash
+    j->base = NULL ;
+    remap( j , JRNL_CHUNK ) ;
+    j->tail = j->synced = 0 ;
+    pthread_mutex_unlock( &j->lock ) ;
+
+    fn( j , arg ) ;
+    journalCommit( j , 1 ) ;
+
+    if ( rename( tmp , j->path ) < 0 )
+        err_sys( "journal: cannot rename the checkpoint" ) ;
+    snprintf( dir , sizeof( dir ) , "%s" , j->path ) ;
+    if ( ( dirFd = open( dirname( dir ) , O_RDONLY ) ) < 0 || fsync( dirFd ) < 0 )
+        err_sys( "journal: cannot sync the journal's directory" ) ;
+    close( dirFd ) ;
+    close( oldFd ) ;        // drops the old file and its lock
+}
+
+//------------------
+
+void journalClose( journal_t *j )
+{
+    pthread_mutex_lock( &j->lock ) ;
+    waitIdle( j ) ;
+    syncAll( j ) ;
+    pthread_mutex_unlock( &j->lock ) ;
+    munmap( j->base , j->mapLen ) ;
+    close( j->fd ) ;
+    free( j->path ) ;
+    j->base = NULL ;
+    j->path = NULL ;
+}
@@ -0,0 +1,72 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : journal.h
+//---------------------------------------------------------------------
+
+#ifndef  JOURNAL_H
+#define  JOURNAL_H
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define JRNL_MAGIC        0x4A524E4C   /* "JRNL" mixed into every record checksum */
+#define JRNL_CHUNK        (1 << 20)    /* file grows in multiples of this many bytes */
+#define JRNL_GROUP_RECS   64           /* sync at the next commit once this many records are pending */
+#define JRNL_GROUP_USEC   2000         /* ... or once the oldest pending record is this old
+                                          ( the caller asks journalDueUs() when that is ) */
+
+typedef enum
+{
+    JRNL_END = 0 ,     /* zero-filled tail of the file */
+    JRNL_ACCEPT ,      /* order accepted : amount = parts added to the order   */
+    JRNL_CLAIM  ,      /* a claimed batch was made and reported : amount = parts */
+    JRNL_COMPLETE ,    /* order finished, nothing left in flight */
+    JRNL_CANCEL        /* order withdrawn by the client : amount = parts made */
+} jrnlType_t ;
+
+typedef struct {
+
+    uint32_t    type ,          /* one of jrnlType_t */
+                orderID ,       /* server-assigned order ID */
+                clientIP ,      /* client's address, network byte order */
+                clientOrder ,   /* client-assigned order ID */
+                amount ;        /* #of parts, meaning depends on type */
+    uint16_t    clientPort ,    /* client's port, network byte order */
+                pad ;
+    uint32_t    check ;         /* detects a torn record at the tail */
+
+} jrnlRec ;
+
+typedef struct {
+
+    int         fd ;
+    char       *path ;          /* where the log lives, for checkpoints */
+    char       *base ;          /* mmap'd view of the whole file */
+    size_t      mapLen ,        /* bytes currently mapped ( = file size ) */
+                tail ,          /* byte offset of the next record */
+                synced ;        /* everything before this offset is durable */
+    unsigned    pending ;       /* records appended since the last sync */
+    long long   firstPendingUs ;
+    int         syncing ;       /* msyncs running outside the lock */
+    pthread_mutex_t lock ;      /* guards all of the above */
+    pthread_cond_t  idle ;      /* signalled when 'syncing' drops to 0 */
+
+} journal_t ;
+
+typedef void jrnlReplayFunc( const jrnlRec *r , void *arg ) ;
+typedef void jrnlCheckpointFunc( journal_t *j , void *arg ) ;
+
+void    journalOpen  ( journal_t *j , const char *path ) ;
+size_t  journalReplay( journal_t *j , jrnlReplayFunc *fn , void *arg ) ;
+void    journalAppend( journal_t *j , jrnlType_t type , unsigned orderID ,
+                       uint32_t clientIP , uint16_t clientPort , unsigned clientOrder ,
+                       unsigned amount ) ;
+void    journalCommit( journal_t *j , int force ) ;
+long long journalDueUs( journal_t *j ) ;
+void    journalReset ( journal_t *j ) ;
+void    journalCheckpoint( journal_t *j , jrnlCheckpointFunc *fn , void *arg ) ;
+void    journalClose ( journal_t *j ) ;
+
+#endif
@@ -37,6 +37,29 @@ void printMsg( msgBuf *m )
             printf( "{ PROTOCOL_ERROR }" ) ;
             break ;
 
+        case CANCEL_MSG :
+            printf( "{ CANCEL     , OrderID=%-3d }" , ntohl(m->orderID) ) ;
+            break ;
+
+        case CANCEL_CONFIRM :
+            printf( "{ CNCL_CNFRM , OrderID=%-3d, OrderSz=%-4d, Made=%-4d }"
+                   , ntohl(m->orderID) , ntohl(m->orderSize) , ntohl(m->partsMade) ) ;
+            break ;
+
+        case BULK_REQUEST :
+        case BULK_CONFIRM :
+            printBulkMsg( (bulkMsgBuf *) m ) ;
+            break ;
+
+        case CAPACITY_QUERY :
+            printf( "{ CAP_QUERY  }" ) ;
+            break ;
+
+        case CAPACITY_INFO :
+            printf( "{ CAP_INFO   , numFacThrds=%-3d, Capacity=%-3d, duration=%-4dms }"
+                   , ntohl(m->numFac) , ntohl(m->capacity) , ntohl(m->duration) ) ;
+            break ;
+
         default :
             printf( "{ UNDEFINED_MSG }" ) ;
             break ;
@@ -44,3 +67,32 @@ void printMsg( msgBuf *m )
 
 }
 
+
+/*--------------------------------------------------------------------
+   Print a bulk message buffer
+----------------------------------------------------------------------*/
+void printBulkMsg( bulkMsgBuf *m )
+{
+    unsigned n = ntohl( m->numOrders ) ;
+
+    switch ( ntohl( m->purpose ) )
+    {
+        case BULK_REQUEST :
+            printf( "{ BULK_REQST , numOrders=%-4u" , n ) ;
+            break ;
+
+        case BULK_CONFIRM :
+            printf( "{ BULK_CNFRM , numOrders=%-4u" , n ) ;
+            break ;
+
+        default :
+            printf( "{ UNDEFINED_MSG }" ) ;
+            return ;
+    }
+
+    if ( n > 0 && n <= MAXBULK )
+        printf( ", first=( ID=%u , %u ) , last=( ID=%u , %u )"
+              , ntohl( m->order[0].orderID ) , ntohl( m->order[0].amount )
+              , ntohl( m->order[n-1].orderID ) , ntohl( m->order[n-1].amount ) ) ;
+    printf( " }" ) ;
+}
@@ -7,25 +7,52 @@
 #ifndef  MESSAGE_H
 #define  MESSAGE_H
 #include <sys/types.h>
+#include <stddef.h>
 
 typedef enum 
 {
-    PRODUCTION_MSG = 1 , COMPLETION_MSG , REQUEST_MSG , ORDR_CONFIRM , PROTOCOL_ERR 
+    PRODUCTION_MSG = 1 , COMPLETION_MSG , REQUEST_MSG , ORDR_CONFIRM , PROTOCOL_ERR ,
+    BULK_REQUEST , BULK_CONFIRM , CANCEL_MSG , CANCEL_CONFIRM ,
+    CAPACITY_QUERY , CAPACITY_INFO
 } msgPurpose_t;
 
+#define MAXBULK   1024     /* max orders carried by one bulk message */
+
 typedef struct {
 
     msgPurpose_t   purpose ;      /* Purpose of this message to Supervisor */
 
-    unsigned       orderSize ,    /* Initial requested order size */
-                   numFac    ,    /* number of Factory Threads serving the client */
+    unsigned       orderSize ,    /* Initial requested order size ( CANCEL_CONFIRM: 0 if unknown ) */
+                   numFac    ,    /* number of Factory Threads serving the client ( CAPACITY_INFO: in total ) */
                    facID     ,    /* sender's Factory ID */
-                   capacity  ,    /* #of parts made in most recent iteration */
+                   capacity  ,    /* #of parts made in most recent iteration ( CAPACITY_INFO: per line ) */
                    partsMade ,    /* #of parts made in most recent iteration */
-                   duration  ;    /* how long it took to make them */
+                   duration  ,    /* how long it took to make them ( CAPACITY_INFO: per iteration ) */
+                   orderID   ;    /* client-assigned order ID, 0 for a single order ( PROTOCOL_ERR: the order it is about ) */
 
 } msgBuf ;
 
+/* Clients built before orderID existed send msgBuf without it; such a
+   message is about order 0 */
+#define MSG_MIN_LEN   offsetof( msgBuf , orderID )
+
+typedef struct {
+
+    msgPurpose_t   purpose ;      /* BULK_REQUEST or BULK_CONFIRM */
+
+    unsigned       numOrders ;    /* entries used in order[] */
+
+    struct {
+        unsigned   orderID ,      /* client-assigned order ID */
+                   amount  ;      /* BULK_REQUEST: order size , BULK_CONFIRM: numFac ( 0 = rejected ) */
+    }              order[ MAXBULK ] ;
+
+} bulkMsgBuf ;
+
+/* Bytes actually sent for a bulk message with 'n' orders */
+#define BULK_MSG_LEN( n )   ( sizeof( bulkMsgBuf ) - ( MAXBULK - (n) ) * sizeof( ( (bulkMsgBuf *) 0 )->order[0] ) )
+
 void printMsg( msgBuf *m ) ;
+void printBulkMsg( bulkMsgBuf *m ) ;
 
 #endif
\ No newline at end of file
@@ -18,11 +18,14 @@
 #include <time.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <poll.h>
 
 #include "wrappers.h"
 #include "message.h"
+#include "capture.h"
 
 #define MAXFACTORIES    20
+#define MAXORDERS       MAXBULK
 
 typedef struct sockaddr SA ;
 
@@ -34,6 +37,18 @@ int main( int argc , char *argv[] )
             iters[ MAXFACTORIES+1 ] = {0} ,  // num Iterations completed by each Factory
             partsMade[ MAXFACTORIES+1 ] = {0} , totalItems = 0;
 
+    static int  orderMade[ MAXORDERS+1 ] ,   // parts made for each client order ID
+                orderLines[ MAXORDERS+1 ] ;  // Completion Messages still due for each order
+    static char lineDone[ MAXORDERS+1 ][ MAXFACTORIES+1 ] ;   // Completion Messages seen
+    unsigned    numOrders = 1 ,              // > 1 sends one BULK_REQUEST
+                numCancelled = 0 ;
+    int         cancelAfter = -1 ,           // mSec after confirmation to cancel, -1 = never
+                timeoutSecs = 0 ,            // give up after this much silence, 0 = wait forever
+                gaveUp = 0 ;
+    capture_t  *cap = NULL ;                 // -w: record all traffic for replay
+    ssize_t     len ;
+    int         opt ;
+
     socklen_t addrLen;
 
     char  *myName = "Kyle Mirra and Akwasi Okyere" ; 
@@ -46,15 +61,41 @@ int main( int argc , char *argv[] )
     fprintf( stdout , "Logged in as user '%s' on %s\n\n" , myUserName ,  ctime( &now)  ) ;
     fflush( stdout ) ;
     
-    if ( argc < 4 )
+    while ( ( opt = getopt( argc , argv , "n:c:t:w:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+          case 'n':
+            numOrders = atoi( optarg ) ;    // place this many orders in one datagram
+            break ;
+
+          case 'c':
+            cancelAfter = atoi( optarg ) ;  // withdraw what is left after this many mSec
+            break ;
+
+          case 't':
+            timeoutSecs = atoi( optarg ) ;  // e.g. when datagrams may be lost on the way
+            break ;
+
+          case 'w':
+            cap = capCreate( optarg ) ;     // binary capture, see the replay tool
+            break ;
+
+          default:
+            argc = 0 ;                      // print the usage below
+            break ;
+        }
+    }
+
+    if ( argc - optind < 3 || numOrders < 1 || numOrders > MAXORDERS )
     {
-        printf("PROCUREMENT Usage: %s  <order_size> <FactoryServerIP>  <port>\n" , argv[0] );
+        printf("PROCUREMENT Usage: %s  [-n numOrders]  [-c cancelAfterMs]  [-t timeoutSecs]  [-w captureFile]  <order_size> <FactoryServerIP>  <port>\n" , argv[0] );
         exit( -1 ) ;  
     }
 
-    unsigned        orderSize  = atoi( argv[1] ) ;
-    char	       *serverIP   = argv[2] ;
-    unsigned short  port       = (unsigned short) atoi( argv[3] ) ;
+    unsigned        orderSize  = (unsigned) strtoul( argv[optind] , NULL , 10 ) ;
+    char	       *serverIP   = argv[optind+1] ;
+    unsigned short  port       = (unsigned short) atoi( argv[optind+2] ) ;
  
 
     /* Set up local and remote sockets */
@@ -63,6 +104,13 @@ int main( int argc , char *argv[] )
         err_sys("Error creating socket");
     }
 
+    if (timeoutSecs > 0) {
+        struct timeval tv = { timeoutSecs, 0 };
+        if (setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0) {
+            err_sys("Error setting the receive timeout");
+        }
+    }
+
     // Prepare the server's socket address structure
     struct sockaddr_in srvrSkt;
     memset((void *) &srvrSkt, 0, sizeof(srvrSkt));
@@ -72,58 +120,193 @@ int main( int argc , char *argv[] )
         err_sys("Invalid IP Address");
     }
 
-    // Send the initial request to the Factory Server
+    // Send the initial request to the Factory Server.
+    // Several orders go out together as one bulk request, with IDs 1..numOrders
+    static bulkMsgBuf  bulk1 ;
     msgBuf  msg1;
+    memset((void *) &msg1, 0, sizeof(msg1));
     msg1.orderSize = htonl(orderSize);
     msg1.purpose = htonl(REQUEST_MSG);
 
-    if (sendto(sd, (void *) &msg1, sizeof(msg1), 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
-        err_sys("Error sending request message");
+    bulk1.purpose = htonl(BULK_REQUEST);
+    bulk1.numOrders = htonl(numOrders);
+    for (unsigned i = 0; i < numOrders; i++) {
+        bulk1.order[i].orderID = htonl(i + 1);
+        bulk1.order[i].amount = htonl(orderSize);
     }
 
     printf("Attempting factory server at %s : %hu\n", serverIP, port);
-    printf("\nPROCUREMENT Sent this message to the FACTORY server: "  );
-    printMsg( & msg1 );  puts("");
+    if (numOrders == 1) {
+        if (sendto(sd, (void *) &msg1, sizeof(msg1), 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
+            err_sys("Error sending request message");
+        }
+        capRecord(cap, CAP_SENT, &srvrSkt, &msg1, sizeof(msg1));
+        printf("\nPROCUREMENT Sent this message to the FACTORY server: "  );
+        printMsg( & msg1 );  puts("");
+    }
+    else {
+        if (sendto(sd, (void *) &bulk1, BULK_MSG_LEN(numOrders), 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
+            err_sys("Error sending bulk request message");
+        }
+        capRecord(cap, CAP_SENT, &srvrSkt, &bulk1, BULK_MSG_LEN(numOrders));
+        printf("\nPROCUREMENT Sent this message to the FACTORY server: "  );
+        printBulkMsg( & bulk1 );  puts("");
+    }
 
     /* Now, wait for order confirmation from the Factory server */
-    msgBuf  msg2;
+    static bulkMsgBuf  msg2;
     printf ("\nPROCUREMENT is now waiting for order confirmation ...\n" );
 
     addrLen = sizeof(srvrSkt);
-    if (recvfrom(sd, (void *) &msg2, sizeof(msg2), 0, (SA *) &srvrSkt, &addrLen) < 0) {
+    if ((len = recvfrom(sd, (void *) &msg2, sizeof(msg2), 0, (SA *) &srvrSkt, &addrLen)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            printf("PROCUREMENT: No order confirmation within %d seconds\n", timeoutSecs);
+            close(sd);
+            exit(2);
+        }
         err_sys("Error receiving order confirmation message");
     }
+    capRecord(cap, CAP_RCVD, &srvrSkt, &msg2, len);
 
     printf("PROCUREMENT received this from the FACTORY server: "  );
-    printMsg( & msg2 );  puts("\n");
+    printMsg( (msgBuf *) & msg2 );  puts("\n");
+
+    // Every order's lines send it their own Completion Message
+    numFactories = 0;
+    activeFactories = 0;
+    if (numOrders == 1 && ntohl(msg2.purpose) == ORDR_CONFIRM) {
+        msgBuf cnf;
+        memcpy(&cnf, &msg2, sizeof(cnf));
+        numFactories = ntohl(cnf.numFac);
+        activeFactories = numFactories;
+        orderLines[0] = numFactories;
+    }
+    else if (numOrders > 1 && ntohl(msg2.purpose) == BULK_CONFIRM
+             && ntohl(msg2.numOrders) == numOrders) {
+        for (unsigned i = 0; i < numOrders; i++) {
+            int n = ntohl(msg2.order[i].amount);
+            if (n == 0)
+                printf("PROCUREMENT: Order #%u was rejected\n", ntohl(msg2.order[i].orderID));
+            numFactories = n > numFactories ? n : numFactories;
+            activeFactories += n;
+            orderLines[i + 1] = n;
+        }
+    }
+    else {
+        printf("PROCUREMENT: Order was not confirmed\n");
+        close(sd);
+        exit(1);
+    }
+
+    if (numFactories > MAXFACTORIES) {
+        printf("PROCUREMENT: Cannot track more than %d factory lines\n", MAXFACTORIES);
+        close(sd);
+        exit(1);
+    }
 
-    numFactories = ntohl(msg2.numFac);
-    activeFactories = numFactories;
+    struct timespec cancelAt;
+    clock_gettime(CLOCK_MONOTONIC, &cancelAt);
+    cancelAt.tv_sec  += cancelAfter / 1000;
+    cancelAt.tv_nsec += (cancelAfter % 1000) * 1000000L;
 
     // Monitor all Active Factory Lines & Collect Production Reports
     while ( activeFactories > 0 ) // wait for messages from sub-factories
     {
+        // Time to withdraw whatever is still in production?
+        if (cancelAfter >= 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long waitMs = (cancelAt.tv_sec - now.tv_sec) * 1000 + (cancelAt.tv_nsec - now.tv_nsec) / 1000000;
+            struct pollfd pfd = { sd, POLLIN, 0 };
+
+            if (waitMs <= 0 || poll(&pfd, 1, (int) waitMs) == 0) {
+                for (unsigned i = 0; i <= numOrders; i++) {
+                    if (orderLines[i] == 0)
+                        continue;
+                    msgBuf cnclMsg;
+                    memset((void *) &cnclMsg, 0, sizeof(cnclMsg));
+                    cnclMsg.purpose = htonl(CANCEL_MSG);
+                    cnclMsg.orderID = htonl(i);
+                    if (sendto(sd, (void *) &cnclMsg, sizeof(cnclMsg), 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
+                        err_sys("Error sending cancel message");
+                    }
+                    capRecord(cap, CAP_SENT, &srvrSkt, &cnclMsg, sizeof(cnclMsg));
+                    printf("\nPROCUREMENT Sent this message to the FACTORY server: "  );
+                    printMsg( & cnclMsg );  puts("");
+                }
+                cancelAfter = -1;
+                continue;
+            }
+        }
+
         // Receive the update message
         msgBuf updtMsg;
-        if (recvfrom(sd, (void *) &updtMsg, sizeof(updtMsg), 0, (SA *) &srvrSkt, &addrLen) < 0) {
+        if ((len = recvfrom(sd, (void *) &updtMsg, sizeof(updtMsg), 0, (SA *) &srvrSkt, &addrLen)) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                printf("PROCUREMENT: Gave up after %d seconds of silence with %d lines still active\n",
+                       timeoutSecs, activeFactories);
+                gaveUp = 1;
+                break;
+            }
             err_sys("Error receiving update message");
         }
+        capRecord(cap, CAP_RCVD, &srvrSkt, &updtMsg, len);
 
         int facID = ntohl(updtMsg.facID);
+        unsigned orderID = ntohl(updtMsg.orderID);
         int msgPartsMade = ntohl(updtMsg.partsMade);
         unsigned duration = ntohl(updtMsg.duration);
         msgPurpose_t purpose = ntohl(updtMsg.purpose);
 
+        // A confirmation again means a retransmitted request reached the
+        // factory twice; it is the same order, so there is nothing to do
+        if (purpose == ORDR_CONFIRM || purpose == BULK_CONFIRM) {
+            printf("PROCUREMENT: Ignored a repeated order confirmation\n");
+            continue;
+        }
+
+        if (orderID > numOrders || ((purpose == PRODUCTION_MSG || purpose == COMPLETION_MSG)
+                                    && (facID < 1 || facID > MAXFACTORIES))) {
+            printf("PROCUREMENT: Received a report from unknown Factory #%d\n", facID);
+            close(sd);
+            exit(1);
+        }
+
        // Inspect the incoming message
         if (purpose == PRODUCTION_MSG) {
         iters[facID]++;
         partsMade[facID] += msgPartsMade;
-        printf("PROCUREMENT: Factory #%3d produced %5d parts in %5d milliSecs\n", facID, msgPartsMade, duration);
+        orderMade[orderID] += msgPartsMade;
+        printf("PROCUREMENT: Factory #%3d produced %5d parts in %5d milliSecs ( capacity %d )\n",
+               facID, msgPartsMade, duration, (int) ntohl(updtMsg.capacity));
         } 
+        else if (purpose == COMPLETION_MSG && lineDone[orderID][facID]) {
+            // A duplicated datagram: this line already completed the order
+            printf("PROCUREMENT: Ignored a repeated completion from Factory #%d\n", facID);
+        }
         else if (purpose == COMPLETION_MSG) {
+            lineDone[orderID][facID] = 1;
             activeFactories--;
+            orderLines[orderID]--;
             printf("PROCUREMENT:rn were not  Factory #%d         COMPLETED its task\n", facID);
         }
+        else if (purpose == CANCEL_CONFIRM && orderLines[orderID] == 0) {
+            // A duplicated datagram, or the order finished before the cancel
+            printf("PROCUREMENT: Ignored a cancel confirmation for an order already accounted for\n");
+        }
+        else if (purpose == CANCEL_CONFIRM && ntohl(updtMsg.orderSize) == 0) {
+            // Unknown to the factory: it already completed, and its
+            // Completion Messages have been counted
+            printf("PROCUREMENT: Order #%u was already done when the cancel arrived\n", orderID);
+        }
+        else if (purpose == CANCEL_CONFIRM) {
+            // The factory will send no more reports for this order
+            activeFactories -= orderLines[orderID];
+            orderLines[orderID] = 0;
+            numCancelled++;
+            printf("PROCUREMENT: Order #%u CANCELLED after %d parts ", orderID, msgPartsMade);
+            printMsg(&updtMsg); puts("");
+        }
         else if (purpose == PROTOCOL_ERR){
             printf("PROCUREMENT: Received invalid msg ");
             printMsg(&updtMsg); puts("");
@@ -146,9 +329,19 @@ int main( int argc , char *argv[] )
 
     printf("==============================\n") ;
 
-    printf("Grand total parts made = %5d vs order size of %5d\n", totalItems, orderSize);
+    if (numOrders > 1) {
+        for (unsigned i = 1; i <= numOrders; i++)
+            if (orderMade[i] != (int) orderSize)
+                printf("Order #%4u made %5d parts vs order size of %5u\n", i, orderMade[i], orderSize);
+        printf("Grand total parts made = %5d vs %u orders of %5u\n", totalItems, numOrders, orderSize);
+    }
+    else
+        printf("Grand total parts made = %5d vs order size of %5u\n", totalItems, orderSize);
+    if (numCancelled > 0)
+        printf("Cancelled %u of %u orders before they completed\n", numCancelled, numOrders);
 
     printf( "\n>>> PROCUREMENT Terminated\n");
 
-    return 0 ;
+    capClose(cap);
+    return gaveUp ? 2 : 0 ;
 }
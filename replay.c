@@ -0,0 +1,369 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : replay.c
+//
+// Replays a capture made with 'procurement -w' against a factory
+// server, either at the original pacing or as fast as possible (-f),
+// then prints the summary and latency profile of the original run
+// next to those of the replay.
+//---------------------------------------------------------------------
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <poll.h>
+#include <stdint.h>
+
+#include "wrappers.h"
+#include "message.h"
+#include "capture.h"
+
+#define MAXLINES    256         /* factory line IDs tracked per summary */
+
+typedef struct sockaddr SA ;
+
+typedef struct {
+    capRecHdr   h ;
+    char       *data ;
+} record_t ;
+
+typedef struct {
+
+    long long   firstSendUs , confirmUs , doneUs , lastReportUs ;
+    unsigned    requests , cancelsSent , confirmedLines , reports ,
+                completions , cancelled , errors ;
+    long        outstanding ;                   // Completion Messages still due
+    unsigned long parts ;
+    unsigned    partsBy[ MAXLINES+1 ] , itersBy[ MAXLINES+1 ] ;
+    int         orderLines[ MAXBULK+1 ] ;       // Completion Messages due per order
+    uint8_t     confirmed[ MAXBULK+1 ] ,        // orders whose lines are counted
+                lineDone[ MAXBULK+1 ][ ( MAXLINES + 8 ) / 8 ] ;   // completions seen
+    long long  *gaps ;                          // uSec between consecutive reports
+    size_t      numGaps , maxGaps ;
+
+} summary_t ;
+
+summary_t   orig , rply ;
+
+//------------------------------------------------------------
+//  Account for one datagram of a run, sent or received at tUs
+//------------------------------------------------------------
+void feed( summary_t *s , long long tUs , capDir_t dir , const void *data , size_t len )
+{
+    const msgBuf      *m = data ;
+    const bulkMsgBuf  *b = data ;
+
+    if ( len < sizeof( msgPurpose_t ) )
+        return ;
+
+    if ( dir == CAP_SENT )
+    {
+        if ( s->requests + s->cancelsSent == 0 )
+            s->firstSendUs = tUs ;
+        if ( ntohl( m->purpose ) == CANCEL_MSG )
+            s->cancelsSent++ ;
+        else
+            s->requests++ ;
+        return ;
+    }
+
+    unsigned  id = len >= sizeof( msgBuf ) ? ntohl( m->orderID ) : 0 ;
+    if ( id > MAXBULK )
+        id = 0 ;
+
+    switch ( ntohl( m->purpose ) )
+    {
+      // A retransmitted request or a duplicated datagram confirms an
+      // order again; only its first confirmation counts
+      case ORDR_CONFIRM:
+        if ( s->confirmUs == 0 )
+            s->confirmUs = tUs ;
+        if ( s->confirmed[ id ] )
+            break ;
+        s->confirmed[ id ] = 1 ;
+        s->confirmedLines  += ntohl( m->numFac ) ;
+        s->outstanding     += ntohl( m->numFac ) ;
+        s->orderLines[ id ] += ntohl( m->numFac ) ;
+        break ;
+
+      case BULK_CONFIRM:
+        if ( s->confirmUs == 0 )
+            s->confirmUs = tUs ;
+        for ( unsigned i = 0 ; i < ntohl( b->numOrders ) && BULK_MSG_LEN( i + 1 ) <= len ; i++ )
+        {
+            unsigned oid = ntohl( b->order[ i ].orderID ) , n = ntohl( b->order[ i ].amount ) ;
+            if ( oid > MAXBULK || s->confirmed[ oid ] )
+                continue ;
+            s->confirmed[ oid ] = 1 ;
+            s->confirmedLines  += n ;
+            s->outstanding     += n ;
+            s->orderLines[ oid ] += n ;
+        }
+        break ;
+
+      case PRODUCTION_MSG:
+      {
+        unsigned fac = ntohl( m->facID ) ;
+        s->reports++ ;
+        s->parts += ntohl( m->partsMade ) ;
+        if ( fac <= MAXLINES ) {
+            s->partsBy[ fac ] += ntohl( m->partsMade ) ;
+            s->itersBy[ fac ]++ ;
+        }
+        if ( s->reports > 1 ) {
+            if ( s->numGaps == s->maxGaps ) {
+                s->maxGaps = s->maxGaps ? 2 * s->maxGaps : 1024 ;
+                if ( ( s->gaps = realloc( s->gaps , s->maxGaps * sizeof( long long ) ) ) == NULL )
+                    err_quit( "replay: out of memory\n" ) ;
+            }
+            s->gaps[ s->numGaps++ ] = tUs - s->lastReportUs ;
+        }
+        s->lastReportUs = tUs ;
+        break ;
+      }
+
+      case COMPLETION_MSG:
+      {
+        // Each line completes an order once; a second one is a duplicate
+        unsigned fac = ntohl( m->facID ) ;
+        if ( fac <= MAXLINES ) {
+            if ( s->lineDone[ id ][ fac / 8 ] & ( 1 << fac % 8 ) )
+                break ;
+            s->lineDone[ id ][ fac / 8 ] |= 1 << fac % 8 ;
+        }
+        s->completions++ ;
+        s->outstanding-- ;
+        s->orderLines[ id ]-- ;
+        break ;
+      }
+
+      case CANCEL_CONFIRM:
+        s->cancelled++ ;
+        s->outstanding -= s->orderLines[ id ] ;
+        s->orderLines[ id ] = 0 ;
+        break ;
+
+      case PROTOCOL_ERR:
+        s->errors++ ;
+        s->outstanding = 0 ;    // procurement gives up on a protocol error
+        break ;
+    }
+
+    if ( s->confirmUs != 0 && s->outstanding <= 0 && s->doneUs == 0 )
+        s->doneUs = tUs ;
+}
+
+//------------------------------------------------------------
+//  Report-gap percentile in mSec
+//------------------------------------------------------------
+int cmpLL( const void *a , const void *b )
+{
+    long long x = *(const long long *) a , y = *(const long long *) b ;
+    return x < y ? -1 : x > y ;
+}
+
+double gapPct( summary_t *s , double pct )
+{
+    if ( s->numGaps == 0 )
+        return 0 ;
+    size_t i = (size_t) ( pct / 100.0 * ( s->numGaps - 1 ) + 0.5 ) ;
+    return s->gaps[ i ] / 1000.0 ;
+}
+
+//------------------------------------------------------------
+//  Print one row of the comparison
+//------------------------------------------------------------
+void row( const char *name , double a , double b )
+{
+    printf( "%-28s %12.1f %12.1f %+12.1f\n" , name , a , b , b - a ) ;
+}
+
+// A row that only means something for a run that completed
+void doneRow( const char *name , double a , double b )
+{
+    if ( orig.doneUs && rply.doneUs )
+        row( name , a , b ) ;
+    else if ( orig.doneUs )
+        printf( "%-28s %12.1f %12s %12s\n" , name , a , "incomplete" , "" ) ;
+    else if ( rply.doneUs )
+        printf( "%-28s %12s %12.1f %12s\n" , name , "incomplete" , b , "" ) ;
+    else
+        printf( "%-28s %12s %12s %12s\n" , name , "incomplete" , "incomplete" , "" ) ;
+}
+
+void printSummaries( void )
+{
+    qsort( orig.gaps , orig.numGaps , sizeof( long long ) , cmpLL ) ;
+    qsort( rply.gaps , rply.numGaps , sizeof( long long ) , cmpLL ) ;
+
+    double origMs = orig.doneUs ? ( orig.doneUs - orig.firstSendUs ) / 1000.0 : 0 ;
+    double rplyMs = rply.doneUs ? ( rply.doneUs - rply.firstSendUs ) / 1000.0 : 0 ;
+
+    printf( "\n\n****** REPLAY Comparison Report ******\n" ) ;
+    printf( "%-28s %12s %12s %12s\n" , "" , "original" , "replay" , "delta" ) ;
+    row( "requests sent"          , orig.requests       , rply.requests ) ;
+    row( "cancels sent"           , orig.cancelsSent    , rply.cancelsSent ) ;
+    row( "lines confirmed"        , orig.confirmedLines , rply.confirmedLines ) ;
+    row( "production reports"     , orig.reports        , rply.reports ) ;
+    row( "parts made"             , orig.parts          , rply.parts ) ;
+    row( "completions"            , orig.completions    , rply.completions ) ;
+    row( "orders cancelled"       , orig.cancelled      , rply.cancelled ) ;
+    row( "protocol errors"        , orig.errors         , rply.errors ) ;
+    row( "confirm latency (ms)"   , orig.confirmUs ? ( orig.confirmUs - orig.firstSendUs ) / 1000.0 : 0
+                                  , rply.confirmUs ? ( rply.confirmUs - rply.firstSendUs ) / 1000.0 : 0 ) ;
+    doneRow( "completion time (ms)" , origMs , rplyMs ) ;
+    doneRow( "throughput (parts/s)" , origMs > 0 ? orig.parts * 1000.0 / origMs : 0
+                                    , rplyMs > 0 ? rply.parts * 1000.0 / rplyMs : 0 ) ;
+    row( "report gap p50 (ms)"    , gapPct( &orig , 50 ) , gapPct( &rply , 50 ) ) ;
+    row( "report gap p90 (ms)"    , gapPct( &orig , 90 ) , gapPct( &rply , 90 ) ) ;
+    row( "report gap p99 (ms)"    , gapPct( &orig , 99 ) , gapPct( &rply , 99 ) ) ;
+    row( "report gap max (ms)"    , gapPct( &orig , 100 ) , gapPct( &rply , 100 ) ) ;
+
+    printf( "==============================\n" ) ;
+    for ( int f = 1 ; f <= MAXLINES ; f++ )
+    {
+        if ( orig.itersBy[ f ] == 0 && rply.itersBy[ f ] == 0 )
+            continue ;
+        printf( "Factory #%3d: original %5u parts in %3u iterations , replay %5u parts in %3u iterations\n"
+              , f , orig.partsBy[ f ] , orig.itersBy[ f ] , rply.partsBy[ f ] , rply.itersBy[ f ] ) ;
+    }
+    if ( ! orig.doneUs )
+        printf( "The original run did not complete: not every confirmed line sent its completion\n" ) ;
+    if ( ! rply.doneUs )
+        printf( "The replay did not complete before the timeout\n" ) ;
+}
+
+/*-------------------------------------------------------*/
+int main( int argc , char *argv[] )
+{
+    int         opt , fast = 0 , timeoutSecs = 5 ;
+    record_t   *recs = NULL ;
+    size_t      numRecs = 0 , maxRecs = 0 ;
+    static char buf[ CAP_MAXDATA ] ;
+
+    while ( ( opt = getopt( argc , argv , "ft:" ) ) != -1 )
+    {
+        switch ( opt )
+        {
+          case 'f':
+            fast = 1 ;                      // ignore the original pacing
+            break ;
+
+          case 't':
+            timeoutSecs = atoi( optarg ) ;  // stop after this much silence
+            break ;
+
+          default:
+            argc = 0 ;
+            break ;
+        }
+    }
+
+    if ( argc - optind != 3 )
+    {
+        printf( "REPLAY Usage: %s [-f] [-t timeoutSecs] <captureFile> <FactoryServerIP> <port>\n" , argv[0] ) ;
+        exit( 1 ) ;
+    }
+
+    char           *path     = argv[optind] ;
+    char           *serverIP = argv[optind+1] ;
+    unsigned short  port     = (unsigned short) atoi( argv[optind+2] ) ;
+
+    // Load the capture and summarize the original run
+    capture_t *cap = capOpenRead( path ) ;
+    capRecHdr  h ;
+    while ( capNext( cap , &h , buf ) )
+    {
+        if ( numRecs == maxRecs ) {
+            maxRecs = maxRecs ? 2 * maxRecs : 256 ;
+            if ( ( recs = realloc( recs , maxRecs * sizeof( record_t ) ) ) == NULL )
+                err_quit( "replay: out of memory\n" ) ;
+        }
+        recs[ numRecs ].h = h ;
+        if ( ( recs[ numRecs ].data = malloc( h.len ) ) == NULL )
+            err_quit( "replay: out of memory\n" ) ;
+        memcpy( recs[ numRecs ].data , buf , h.len ) ;
+        feed( &orig , h.tUs , h.dir , buf , h.len ) ;
+        numRecs++ ;
+    }
+    capClose( cap ) ;
+    printf( "REPLAY: loaded %zu datagrams from '%s'\n" , numRecs , path ) ;
+
+    // Set up our own socket, so the factory sees a brand new client
+    struct sockaddr_in  srvrSkt ;
+    memset( (void *) &srvrSkt, 0, sizeof(srvrSkt));
+    srvrSkt.sin_family = AF_INET;
+    srvrSkt.sin_port = htons(port);
+    if (inet_pton(AF_INET, serverIP, (void *) &srvrSkt.sin_addr.s_addr) != 1) {
+        err_quit("Invalid IP Address\n");
+    }
+    int sd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sd < 0) {
+        err_sys("Error creating socket");
+    }
+
+    printf( "REPLAY: sending to %s : %hu %s\n" , serverIP , port ,
+            fast ? "as fast as possible" : "at the original pacing" ) ;
+
+    // Send what procurement sent, collect what comes back
+    long long  t0 = capNowUs() , lastHeard = t0 ;
+    size_t     next = 0 ;
+    long long  firstSent = -1 ;
+
+    for ( ;; )
+    {
+        while ( next < numRecs && recs[ next ].h.dir != CAP_SENT )
+            next++ ;
+
+        long long now = capNowUs() ;
+        if ( next < numRecs )
+        {
+            if ( firstSent < 0 )
+                firstSent = recs[ next ].h.tUs ;
+            long long due = t0 + ( fast ? 0 : (long long) recs[ next ].h.tUs - firstSent ) ;
+            if ( due <= now )
+            {
+                if (sendto(sd, recs[ next ].data, recs[ next ].h.len, 0, (SA *) &srvrSkt, sizeof(srvrSkt)) < 0) {
+                    err_sys("Error sending a replayed datagram");
+                }
+                feed( &rply , now - t0 , CAP_SENT , recs[ next ].data , recs[ next ].h.len ) ;
+                next++ ;
+                lastHeard = now ;
+                continue ;
+            }
+        }
+        else if ( rply.doneUs || now - lastHeard >= timeoutSecs * 1000000LL )
+            break ;
+
+        // Wait for a reply, the next send, or the silence timeout
+        long long until = lastHeard + timeoutSecs * 1000000LL ;
+        if ( next < numRecs )
+            until = t0 + ( fast ? 0 : (long long) recs[ next ].h.tUs - firstSent ) ;
+        struct pollfd pfd = { sd , POLLIN , 0 } ;
+        long long waitUs = until - now ;
+        if ( poll( &pfd , 1 , waitUs <= 0 ? 0 : (int) ( ( waitUs + 999 ) / 1000 ) ) < 0 && errno != EINTR )
+            err_sys( "poll failed" ) ;
+
+        if ( pfd.revents & POLLIN )
+        {
+            ssize_t n = recv( sd , buf , sizeof( buf ) , 0 ) ;
+            if ( n < 0 )
+                err_sys( "Error receiving a reply" ) ;
+            lastHeard = capNowUs() ;
+            feed( &rply , lastHeard - t0 , CAP_RCVD , buf , n ) ;
+        }
+    }
+
+    close( sd ) ;
+    printSummaries() ;
+    return rply.doneUs ? 0 : 2 ;
+}
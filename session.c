@@ -0,0 +1,210 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : session.c
+//
+// Per-order session store. All sessions live in one slab allocated at
+// startup, so serving a message never calls malloc(). Sessions are
+// named by handles that carry a generation count, and are found by
+// client address and client order ID through an open-addressed hash
+// table.
+// The caller provides the locking.
+//---------------------------------------------------------------------
+
+#include "wrappers.h"
+#include "session.h"
+
+#define IDX( h )    ( (h) & SESS_MAX )
+#define GEN( h )    ( (h) >> SESS_IDX_BITS )
+#define GENMASK     ( ( 1u << ( 32 - SESS_IDX_BITS ) ) - 1 )
+
+static uint32_t hashAddr( uint32_t ip , uint16_t port , uint32_t clientOrder )
+{
+    uint64_t k = ( (uint64_t) ip << 16 ) | port ;
+    k ^= (uint64_t) clientOrder * 0x9E3779B97F4A7C15ULL ;
+    k ^= k >> 33 ;
+    k *= 0xff51afd7ed558ccdULL ;
+    k ^= k >> 33 ;
+    return (uint32_t) k ;
+}
+
+static sessHandle_t mkHandle( sessStore_t *st , uint32_t idx )
+{
+    return ( (uint32_t) ( st->slots[ idx ].gen & GENMASK ) << SESS_IDX_BITS ) | idx ;
+}
+
+/*--------------------------------------------------------------------
+   Allocate the slab and the hash table for 'capacity' sessions
+----------------------------------------------------------------------*/
+void sessInit( sessStore_t *st , unsigned capacity )
+{
+    uint32_t  nBuckets = 1 ;
+
+    if ( capacity == 0 || capacity > SESS_MAX )
+        err_quit( "session store: bad capacity\n" ) ;
+
+    while ( nBuckets < 2 * capacity )       // keep the load factor <= 1/2
+        nBuckets <<= 1 ;
+
+    memset( st , 0 , sizeof( *st ) ) ;
+    st->capacity = capacity ;
+    st->hashMask = nBuckets - 1 ;
+    st->slots    = calloc( capacity , sizeof( session_t ) ) ;
+    st->hash     = malloc( nBuckets * sizeof( uint32_t ) ) ;
+    if ( st->slots == NULL || st->hash == NULL )
+        err_quit( "session store: out of memory\n" ) ;
+    memset( st->hash , 0xFF , nBuckets * sizeof( uint32_t ) ) ;
+
+    for ( uint32_t i = 0 ; i < capacity ; i++ )
+        st->slots[ i ].next = i + 1 < capacity ? i + 1 : SESS_NIL ;
+    st->freeHead = 0 ;
+}
+
+//------------------
+// Memory cost of one session, hash table share included
+
+size_t sessBytesPer( const sessStore_t *st )
+{
+    return sizeof( session_t )
+         + ( (size_t) st->hashMask + 1 ) * sizeof( uint32_t ) / st->capacity ;
+}
+
+//------------------
+
+sessHandle_t sessFind( sessStore_t *st , uint32_t ip , uint16_t port , uint32_t clientOrder )
+{
+    uint32_t b = hashAddr( ip , port , clientOrder ) & st->hashMask ;
+
+    for ( ; st->hash[ b ] != SESS_NIL ; b = ( b + 1 ) & st->hashMask )
+    {
+        session_t *s = &st->slots[ st->hash[ b ] ] ;
+        if ( s->clientIP == ip && s->clientPort == port && s->clientOrder == clientOrder )
+            return mkHandle( st , st->hash[ b ] ) ;
+    }
+    return SESS_NIL ;
+}
+
+//------------------
+// Returns SESS_NIL when the store is full
+
+sessHandle_t sessAlloc( sessStore_t *st , uint32_t ip , uint16_t port , uint32_t clientOrder )
+{
+    uint32_t  idx = st->freeHead ;
+
+    if ( idx == SESS_NIL )
+        return SESS_NIL ;
+
+    session_t *s = &st->slots[ idx ] ;
+    st->freeHead = s->next ;
+
+    uint16_t gen = s->gen ;
+    memset( s , 0 , sizeof( *s ) ) ;
+    s->gen        = gen ;
+    s->clientIP   = ip ;
+    s->clientPort = port ;
+    s->clientOrder= clientOrder ;
+    s->next       = SESS_NIL ;
+
+    uint32_t b = hashAddr( ip , port , clientOrder ) & st->hashMask ;
+    while ( st->hash[ b ] != SESS_NIL )
+        b = ( b + 1 ) & st->hashMask ;
+    st->hash[ b ] = idx ;
+
+    st->live++ ;
+    return mkHandle( st , idx ) ;
+}
+
+//------------------
+// Returns NULL for a stale or nil handle
+
+session_t *sessGet( sessStore_t *st , sessHandle_t h )
+{
+    if ( h == SESS_NIL || IDX( h ) >= st->capacity )
+        return NULL ;
+
+    session_t *s = &st->slots[ IDX( h ) ] ;
+    if ( ( s->gen & GENMASK ) != GEN( h ) )
+        return NULL ;
+    return s ;
+}
+
+/*--------------------------------------------------------------------
+   Release a session. It must not be in a run queue.
+----------------------------------------------------------------------*/
+void sessFree( sessStore_t *st , sessHandle_t h )
+{
+    session_t *s = sessGet( st , h ) ;
+    if ( s == NULL )
+        return ;
+
+    // Remove from the hash table with backward-shift deletion
+    uint32_t  idx = IDX( h ) ;
+    uint32_t  b   = hashAddr( s->clientIP , s->clientPort , s->clientOrder ) & st->hashMask ;
+    while ( st->hash[ b ] != idx )
+        b = ( b + 1 ) & st->hashMask ;
+
+    uint32_t  hole = b ;
+    for ( b = ( b + 1 ) & st->hashMask ; st->hash[ b ] != SESS_NIL ; b = ( b + 1 ) & st->hashMask )
+    {
+        session_t *o    = &st->slots[ st->hash[ b ] ] ;
+        uint32_t   home = hashAddr( o->clientIP , o->clientPort , o->clientOrder ) & st->hashMask ;
+
+        // Move the entry into the hole unless its home lies in ( hole , b ]
+        if ( ( ( b - home ) & st->hashMask ) >= ( ( b - hole ) & st->hashMask ) )
+        {
+            st->hash[ hole ] = st->hash[ b ] ;
+            hole = b ;
+        }
+    }
+    st->hash[ hole ] = SESS_NIL ;
+
+    s->gen++ ;
+    s->next = st->freeHead ;
+    st->freeHead = idx ;
+    st->live-- ;
+}
+
+/*--------------------------------------------------------------------
+   Run queues: FIFOs of sessions with parts left to claim.
+   A session is in at most one queue at a time.
+----------------------------------------------------------------------*/
+void sessQueueInit( sessQueue_t *q )
+{
+    q->head = q->tail = SESS_NIL ;
+}
+
+//------------------
+
+void sessEnqueue( sessStore_t *st , sessQueue_t *q , sessHandle_t h )
+{
+    session_t *s = sessGet( st , h ) ;
+    if ( s == NULL || ( s->flags & SESS_QUEUED ) )
+        return ;
+
+    s->flags |= SESS_QUEUED ;
+    s->next = SESS_NIL ;
+    if ( q->tail == SESS_NIL )
+        q->head = IDX( h ) ;
+    else
+        st->slots[ q->tail ].next = IDX( h ) ;
+    q->tail = IDX( h ) ;
+}
+
+//------------------
+// Returns SESS_NIL when the queue is empty
+
+sessHandle_t sessDequeue( sessStore_t *st , sessQueue_t *q )
+{
+    uint32_t idx = q->head ;
+    if ( idx == SESS_NIL )
+        return SESS_NIL ;
+
+    session_t *s = &st->slots[ idx ] ;
+    q->head = s->next ;
+    if ( q->head == SESS_NIL )
+        q->tail = SESS_NIL ;
+    s->next   = SESS_NIL ;
+    s->flags &= ~SESS_QUEUED ;
+    return mkHandle( st , idx ) ;
+}
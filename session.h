@@ -0,0 +1,69 @@
+//---------------------------------------------------------------------
+// Assignment : PA-03 UDP Single-Threaded Server
+// Date       : 11/21/2025
+// Author     : Kyle Mirra      Akwasi Okyere
+// File Name  : session.h
+//---------------------------------------------------------------------
+
+#ifndef  SESSION_H
+#define  SESSION_H
+#include <sys/types.h>
+#include <stdint.h>
+
+#define SESS_IDX_BITS   22                          /* low bits of a handle: slot index */
+#define SESS_MAX        ( ( 1u << SESS_IDX_BITS ) - 1 )
+#define SESS_NIL        0xFFFFFFFFu                 /* "no session" handle / link */
+
+#define SESS_QUEUED     0x0001      /* linked into a run queue */
+#define SESS_CANCELLED  0x0002      /* withdrawn, lines drop it at their next claim */
+
+typedef uint32_t  sessHandle_t ;    /* ( generation << SESS_IDX_BITS ) | index */
+
+typedef struct {
+
+    uint32_t    clientIP ;      /* client's address, network byte order */
+    uint16_t    clientPort ,    /* client's port, network byte order */
+                gen ;           /* bumped on free, so stale handles are caught */
+    uint32_t    clientOrder ,   /* client-assigned order ID */
+                orderID ,       /* server-assigned order ID ( journal key ) */
+                ordered ,       /* parts accepted in total */
+                remains ,       /* parts not yet claimed by any line */
+                made ,          /* parts made and reported */
+                iters ,         /* production iterations reported */
+                next ;          /* run-queue or free-list link ( slot index ) */
+    uint16_t    busyLines ,     /* lines currently making parts for this order */
+                flags ;
+    uint32_t    client ;        /* the client's entry in the client table */
+    uint32_t    acceptMs ;      /* mSec since the server started */
+
+} session_t ;
+
+typedef struct {
+
+    uint32_t    head ,          /* FIFO of sessions linked through 'next' */
+                tail ;
+
+} sessQueue_t ;
+
+typedef struct {
+
+    session_t  *slots ;         /* the slab: 'capacity' sessions, allocated once */
+    uint32_t   *hash ;          /* open-addressed ( IP , port , client order ) -> slot index */
+    uint32_t    capacity ,
+                hashMask ,
+                live ,          /* sessions currently allocated */
+                freeHead ;
+
+} sessStore_t ;
+
+void          sessInit    ( sessStore_t *st , unsigned capacity ) ;
+size_t        sessBytesPer( const sessStore_t *st ) ;
+sessHandle_t  sessFind    ( sessStore_t *st , uint32_t ip , uint16_t port , uint32_t clientOrder ) ;
+sessHandle_t  sessAlloc   ( sessStore_t *st , uint32_t ip , uint16_t port , uint32_t clientOrder ) ;
+session_t    *sessGet     ( sessStore_t *st , sessHandle_t h ) ;
+void          sessFree    ( sessStore_t *st , sessHandle_t h ) ;
+void          sessQueueInit( sessQueue_t *q ) ;
+void          sessEnqueue ( sessStore_t *st , sessQueue_t *q , sessHandle_t h ) ;
+sessHandle_t  sessDequeue ( sessStore_t *st , sessQueue_t *q ) ;
+
+#endif